@@ -0,0 +1,385 @@
+#include <print>
+#include <zlib.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "synthetic.hpp"
+
+import deserializer;
+import packet_stream;
+import parser;
+
+namespace {
+
+  constexpr std::uint8_t mpi_packet_type = 4;
+
+  using synthetic::append_le;
+  using synthetic::append_size_prefix;
+  using synthetic::decode_size_prefix_reference;
+  using synthetic::deflate_stream;
+
+  void append_mpi_packet(
+    std::vector<std::byte>& out, std::uint32_t timestamp_ms, std::uint16_t object_id,
+    std::uint16_t message_id, std::span<const std::byte> body
+  ) {
+    append_size_prefix(out, 1 + sizeof(timestamp_ms) + wrpl::mpi_header_size + body.size());
+    out.push_back(static_cast<std::byte>(mpi_packet_type));
+    append_le(out, timestamp_ms);
+    append_le(out, object_id);
+    out.push_back(std::byte{0});
+    append_le(out, message_id);
+    out.insert(out.end(), body.begin(), body.end());
+  }
+
+  // Tank battle shaped stream: mostly shell trajectories, some hits and kill reports and a share
+  // of other MPI traffic.
+  std::vector<std::byte> build_battle_stream(std::size_t packet_count) {
+    std::vector<std::byte> stream;
+    std::vector<std::byte> body;
+    for (std::size_t i = 0; i < packet_count; ++i) {
+      auto timestamp_ms = static_cast<std::uint32_t>(i * 16);
+      auto object_id = static_cast<std::uint16_t>(0x0100 + i % 32);
+      body.clear();
+
+      switch (i % 10) {
+        case 0:
+          append_le(body, static_cast<std::uint16_t>(i));
+          append_le(body, static_cast<std::uint16_t>(0x0100 + (i + 7) % 32));
+          append_le(body, 10.0f);
+          append_le(body, 2.0f);
+          append_le(body, -4.5f);
+          append_mpi_packet(stream, timestamp_ms, object_id, 0xD0FE, body);
+          break;
+        case 1:
+          body.resize(48, std::byte{0x5A});
+          append_mpi_packet(stream, timestamp_ms, object_id, 0xB065, body);
+          break;
+        case 2:
+          // TextKillReport; its layout is unknown, so the body only gives the packet its size
+          body.resize(12, std::byte{0x3C});
+          append_mpi_packet(stream, timestamp_ms, object_id, 0xF058, body);
+          break;
+        default: {
+          constexpr std::uint8_t records = 8;
+          body.push_back(static_cast<std::byte>(records));
+          for (std::uint8_t r = 0; r < records; ++r) {
+            append_le(body, static_cast<std::uint16_t>(i * records + r));
+            for (float component : {1.0f, 2.0f, 3.0f, 800.0f, 0.5f, -9.8f}) {
+              append_le(body, component * static_cast<float>(r + 1));
+            }
+          }
+          std::uint16_t message_id = i % 10 == 3 ? 0xF11A : 0xF0DB;
+          append_mpi_packet(stream, timestamp_ms, object_id, message_id, body);
+          break;
+        }
+      }
+    }
+    return stream;
+  }
+
+  // Back to back size prefixes with the length mix of a real replay: mostly one and two bytes.
+  std::vector<std::byte> build_prefix_stream(std::size_t prefix_count) {
+    std::vector<std::byte> stream;
+    for (std::size_t i = 0; i < prefix_count; ++i) {
+      std::size_t size = i % 8 < 5 ? i % 0x80 : i % 8 < 7 ? 0x80 + i % 0x3F00 : 0x4000 + i;
+      append_size_prefix(stream, size);
+    }
+    return stream;
+  }
+
+  // Hardware counters read with perf_event_open around each benchmark run. Counters the kernel
+  // refuses (common in containers, or with perf_event_paranoid > 2) are skipped; if none open,
+  // the benchmarks just report wall time. Values are scaled up when the kernel multiplexed them.
+  class perf_counters {
+public:
+    struct counter_spec {
+      const char* name;
+      std::uint32_t type;
+      std::uint64_t config;
+    };
+
+    perf_counters() {
+#if defined(__linux__)
+      constexpr std::uint64_t l1d_read_miss = PERF_COUNT_HW_CACHE_L1D |
+                                              (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      constexpr std::uint64_t llc_read_miss = PERF_COUNT_HW_CACHE_LL |
+                                              (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      const counter_spec specs[] = {
+        {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {"L1d-misses", PERF_TYPE_HW_CACHE, l1d_read_miss},
+        {"LLC-misses", PERF_TYPE_HW_CACHE, llc_read_miss},
+      };
+      for (const counter_spec& spec : specs) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = spec.type;
+        attr.config = spec.config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        auto fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        if (fd < 0) {
+          error_ = std::strerror(errno);
+          continue;
+        }
+        counters_.push_back({spec.name, fd});
+      }
+#else
+      error_ = "perf_event_open is Linux only";
+#endif
+    }
+
+    ~perf_counters() {
+#if defined(__linux__)
+      for (const open_counter& counter : counters_) {
+        close(counter.fd);
+      }
+#endif
+    }
+
+    perf_counters(const perf_counters&) = delete;
+    perf_counters& operator=(const perf_counters&) = delete;
+
+    bool available() const {
+      return !counters_.empty();
+    }
+
+    // why the last counter failed to open
+    std::string_view error() const {
+      return error_;
+    }
+
+    void start() {
+#if defined(__linux__)
+      for (const open_counter& counter : counters_) {
+        ioctl(counter.fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+#endif
+    }
+
+    // Stops counting and returns one (name, value) pair per open counter.
+    std::vector<std::pair<const char*, double>> stop() {
+      std::vector<std::pair<const char*, double>> values;
+#if defined(__linux__)
+      for (const open_counter& counter : counters_) {
+        ioctl(counter.fd, PERF_EVENT_IOC_DISABLE, 0);
+      }
+      for (const open_counter& counter : counters_) {
+        std::array<std::uint64_t, 3> data{}; // value, time enabled, time running
+        if (read(counter.fd, data.data(), sizeof(data)) != sizeof(data) || data[2] == 0) {
+          continue;
+        }
+        double scale = static_cast<double>(data[1]) / static_cast<double>(data[2]);
+        values.emplace_back(counter.name, static_cast<double>(data[0]) * scale);
+      }
+#endif
+      return values;
+    }
+
+private:
+    struct open_counter {
+      const char* name;
+      int fd;
+    };
+
+    std::vector<open_counter> counters_;
+    std::string error_;
+  };
+
+  // Prints the counters of one run divided by its item and byte counts.
+  void print_counters(
+    const std::vector<std::pair<const char*, double>>& values, std::size_t items,
+    std::size_t bytes
+  ) {
+    for (const auto& [name, value] : values) {
+      std::println(
+        "{:<12} {:>16} {:>12.2f} /item {:>10.3f} /byte", "", name,
+        value / static_cast<double>(std::max<std::size_t>(items, 1)),
+        value / static_cast<double>(std::max<std::size_t>(bytes, 1))
+      );
+    }
+  }
+
+  // Decodes every prefix of `stream` with `decode` and reports the best of `iterations` runs.
+  // Returns false if `decode` stopped before all `expected_prefixes` were decoded.
+  template <typename Decode>
+  bool run_prefix_benchmark(
+    const char* name, std::span<const std::byte> stream, std::size_t expected_prefixes,
+    int iterations, perf_counters* counters, Decode decode
+  ) {
+    double best_seconds = 0.0;
+    std::size_t prefixes = 0;
+    std::uint64_t checksum = 0;
+    std::vector<std::pair<const char*, double>> best_counts;
+    for (int i = 0; i < iterations; ++i) {
+      prefixes = 0;
+      checksum = 0;
+      if (counters) {
+        counters->start();
+      }
+      auto start = std::chrono::steady_clock::now();
+      for (std::size_t pos = 0; pos < stream.size(); ++prefixes) {
+        auto result = decode(stream.subspan(pos));
+        if (!result || result->payload_size < 0) {
+          break;
+        }
+        checksum += static_cast<std::uint64_t>(result->payload_size);
+        pos += result->prefix_bytes_read;
+      }
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      std::vector<std::pair<const char*, double>> counts =
+        counters ? counters->stop() : std::vector<std::pair<const char*, double>>{};
+      if (i == 0 || elapsed.count() < best_seconds) {
+        best_seconds = elapsed.count();
+        best_counts = std::move(counts);
+      }
+    }
+    std::println(
+      "{:<12} {:>8.2f} ms  {:>8.2f} ns/prefix  {:>10} items  checksum {:x}", name,
+      best_seconds * 1e3, best_seconds * 1e9 / static_cast<double>(prefixes), prefixes, checksum
+    );
+    print_counters(best_counts, prefixes, stream.size());
+    if (prefixes != expected_prefixes) {
+      std::println(stderr, "{}: decoded {} of {} prefixes", name, prefixes, expected_prefixes);
+      return false;
+    }
+    return true;
+  }
+
+  // Runs `fn` on a fresh stream over `compressed` and reports the best of `iterations` runs.
+  // With `counters`, also reports hardware counters per item and per inflated byte.
+  template <typename Fn>
+  void run_benchmark(
+    const char* name, const std::string& compressed, std::size_t decompressed_bytes,
+    int iterations, perf_counters* counters, Fn fn
+  ) {
+    double best_seconds = 0.0;
+    std::size_t items = 0;
+    std::vector<std::pair<const char*, double>> best_counts;
+    for (int i = 0; i < iterations; ++i) {
+      std::istringstream stream(compressed);
+      if (counters) {
+        counters->start();
+      }
+      auto start = std::chrono::steady_clock::now();
+      items = fn(stream);
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      std::vector<std::pair<const char*, double>> counts =
+        counters ? counters->stop() : std::vector<std::pair<const char*, double>>{};
+      if (i == 0 || elapsed.count() < best_seconds) {
+        best_seconds = elapsed.count();
+        best_counts = std::move(counts);
+      }
+    }
+    std::println(
+      "{:<12} {:>8.2f} ms  {:>8.1f} MB/s  {:>10} items  {:>8.2f} M items/s", name,
+      best_seconds * 1e3, static_cast<double>(decompressed_bytes) / best_seconds / 1e6, items,
+      static_cast<double>(items) / best_seconds / 1e6
+    );
+    print_counters(best_counts, items, decompressed_bytes);
+  }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  std::vector<std::string_view> args;
+  bool use_counters = false;
+  for (int i = 1; i < argc; ++i) {
+    if (std::string_view(argv[i]) == "--perf") {
+      use_counters = true;
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  std::size_t packet_count = args.size() > 0 ? std::stoul(std::string(args[0])) : 200000;
+  int iterations = args.size() > 1 ? std::stoi(std::string(args[1])) : 5;
+
+  std::optional<perf_counters> counters;
+  if (use_counters) {
+    counters.emplace();
+    if (!counters->available()) {
+      std::println(
+        "Hardware counters unavailable ({}); reporting wall time only", counters->error()
+      );
+      counters.reset();
+    }
+  }
+  perf_counters* perf = counters ? &*counters : nullptr;
+
+  std::vector<std::byte> battle_stream = build_battle_stream(packet_count);
+  std::string battle_compressed = deflate_stream(battle_stream);
+  std::println(
+    "Synthetic battle replay: {} packets, {} bytes inflated, {} bytes deflated", packet_count,
+    battle_stream.size(), battle_compressed.size()
+  );
+
+  std::size_t prefix_count = packet_count * 10;
+  std::vector<std::byte> prefix_stream = build_prefix_stream(prefix_count);
+  bool prefixes_ok = run_prefix_benchmark(
+    "prefix ref", prefix_stream, prefix_count, iterations, perf, decode_size_prefix_reference
+  );
+  prefixes_ok &= run_prefix_benchmark(
+    "prefix", prefix_stream, prefix_count, iterations, perf, wrpl::decode_size_prefix
+  );
+
+  // inflate alone, straight from memory into a reused chunk; items are inflated bytes
+  run_benchmark(
+    "inflate", battle_compressed, battle_stream.size(), iterations, perf,
+    [&](std::istream&) {
+      std::vector<Bytef> out(64 * 1024);
+      z_stream z{};
+      inflateInit(&z);
+      z.next_in = reinterpret_cast<Bytef*>(battle_compressed.data());
+      z.avail_in = static_cast<uInt>(battle_compressed.size());
+      std::size_t inflated = 0;
+      int ret = Z_OK;
+      while (ret == Z_OK) {
+        z.next_out = out.data();
+        z.avail_out = static_cast<uInt>(out.size());
+        ret = inflate(&z, Z_NO_FLUSH);
+        inflated += out.size() - z.avail_out;
+      }
+      inflateEnd(&z);
+      return inflated;
+    }
+  );
+
+  run_benchmark(
+    "framing", battle_compressed, battle_stream.size(), iterations, perf,
+    [](std::istream& stream) {
+      std::size_t packets = 0;
+      for (const wrpl::packet_view& packet : wrpl::packets(stream)) {
+        packets += packet.header.has_value();
+      }
+      return packets;
+    }
+  );
+
+  return prefixes_ok ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+#include <print>
+
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "synthetic.hpp"
+
+import parser;
+
+// Checks that a parse stopped after N packets and resumed from its serialized checkpoint prints
+// exactly what an uninterrupted parse prints, for stops on both sides of many deflate blocks.
+
+namespace {
+
+  // Packets with a mix of all three prefix lengths and payloads that deflate poorly enough to
+  // span many deflate blocks, so the stops land at different distances from a block boundary.
+  std::vector<std::byte> build_stream(std::size_t packet_count) {
+    std::vector<std::byte> stream;
+    std::vector<std::byte> packet;
+    std::uint32_t state = 0x2545F491;
+    for (std::size_t i = 0; i < packet_count; ++i) {
+      std::size_t body_size = i % 97 == 0  ? 0x4000 + i % 512
+                              : i % 3 == 0 ? 0x40 + i % 300
+                                           : i % 0x30;
+      packet.clear();
+      packet.push_back(std::byte{4});
+      synthetic::append_le(packet, static_cast<std::uint32_t>(i * 33));
+      for (std::size_t b = 0; b < body_size; ++b) {
+        state = state * 1664525 + 1013904223;
+        // a small alphabet, so the stream still compresses and back references occur
+        packet.push_back(static_cast<std::byte>('a' + (state >> 24) % 12));
+      }
+      synthetic::append_size_prefix(stream, packet.size());
+      stream.insert(stream.end(), packet.begin(), packet.end());
+    }
+    return stream;
+  }
+
+  // One line per packet with everything a dump shows: index, type, timestamp and bytes.
+  void dump_packet(std::string& out, const wrpl::packet_view& packet) {
+    out += std::format("{} {} {} ", packet.index, packet.decompressed_offset, packet.data.size());
+    if (packet.header) {
+      out += std::format("{} {} ", packet.header->packet_type_val, packet.header->timestamp_ms);
+    }
+    for (std::byte b : packet.data) {
+      out += std::format("{:02x}", static_cast<std::uint8_t>(b));
+    }
+    out += '\n';
+  }
+
+  // Frames up to `limit` packets into `out`. Returns false on a framing error.
+  bool dump(wrpl::packet_framer& framer, std::string& out, std::size_t limit = SIZE_MAX) {
+    for (std::size_t count = 0; count < limit; ++count) {
+      auto packet = framer.next_view();
+      if (!packet) {
+        std::println(stderr, "framing failed: {}", packet.error().message());
+        return false;
+      }
+      if (!*packet) {
+        break;
+      }
+      dump_packet(out, **packet);
+    }
+    return true;
+  }
+
+} // namespace
+
+int main() {
+  constexpr std::size_t packet_count = 20000;
+  std::string compressed = synthetic::deflate_stream(build_stream(packet_count));
+
+  std::string expected;
+  {
+    std::istringstream stream(compressed);
+    wrpl::packet_framer framer(stream);
+    if (!dump(framer, expected)) {
+      return 1;
+    }
+  }
+
+  int failures = 0;
+  for (std::size_t stop : {std::size_t{0}, std::size_t{1}, std::size_t{97}, std::size_t{1234},
+                           packet_count / 2, packet_count - 1, packet_count}) {
+    std::string resumed;
+    std::optional<std::vector<std::byte>> blob;
+    {
+      std::istringstream stream(compressed);
+      wrpl::packet_framer framer(stream);
+      framer.track_checkpoints();
+      if (!dump(framer, resumed, stop)) {
+        return 1;
+      }
+      blob = framer.checkpoint().serialize();
+    }
+    if (!blob) {
+      std::println(stderr, "stop {}: checkpoint does not serialize", stop);
+      failures++;
+      continue;
+    }
+    std::optional<wrpl::decoder_checkpoint> checkpoint =
+      wrpl::decoder_checkpoint::deserialize(*blob);
+    if (!checkpoint) {
+      std::println(stderr, "stop {}: checkpoint does not deserialize", stop);
+      failures++;
+      continue;
+    }
+    std::istringstream stream(compressed);
+    wrpl::packet_framer framer(stream, *checkpoint);
+    if (!dump(framer, resumed)) {
+      return 1;
+    }
+    if (resumed != expected) {
+      std::println(stderr, "stop {}: resumed dump differs from the uninterrupted one", stop);
+      failures++;
+    }
+
+    // a corrupt pending size must be rejected before anything is allocated for it
+    constexpr std::size_t pending_size_offset = 57;
+    for (std::size_t i = 0; i < 4; ++i) {
+      (*blob)[pending_size_offset + i] = std::byte{0xFF};
+    }
+    if (wrpl::decoder_checkpoint::deserialize(*blob)) {
+      std::println(stderr, "stop {}: checkpoint with a 4 GiB pending size deserializes", stop);
+      failures++;
+    }
+  }
+
+  std::println("checkpoint check: {} packets, {} failures", packet_count, failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+#include <print>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "synthetic.hpp"
+
+import parser;
+
+// Compares decode_size_prefix with the reference decoder for every first byte, every input
+// length that cuts a prefix short, and sizes at both sides of each prefix length boundary.
+
+namespace {
+
+  int failures = 0;
+
+  void compare(std::span<const std::byte> bytes) {
+    std::optional<wrpl::variable_length_result> fast = wrpl::decode_size_prefix(bytes);
+    std::optional<synthetic::decoded_size_prefix> reference =
+      synthetic::decode_size_prefix_reference(bytes);
+    bool same = fast.has_value() == reference.has_value() &&
+                (!fast || (fast->payload_size == reference->payload_size &&
+                           fast->prefix_bytes_read == reference->prefix_bytes_read));
+    if (!same) {
+      std::print(stderr, "mismatch for");
+      for (std::byte b : bytes) {
+        std::print(stderr, " {:02x}", static_cast<std::uint8_t>(b));
+      }
+      std::println(stderr, "");
+      failures++;
+    }
+  }
+
+  void check_round_trip(std::size_t size, std::size_t expected_length) {
+    std::vector<std::byte> bytes;
+    synthetic::append_size_prefix(bytes, size);
+    compare(bytes);
+    std::optional<wrpl::variable_length_result> decoded = wrpl::decode_size_prefix(bytes);
+    if (bytes.size() != expected_length || !decoded ||
+        decoded->payload_size != static_cast<std::int64_t>(size) ||
+        decoded->prefix_bytes_read != expected_length) {
+      std::println(stderr, "size {:#x} does not round trip in {} bytes", size, expected_length);
+      failures++;
+    }
+  }
+
+} // namespace
+
+int main() {
+  constexpr std::uint8_t tails[][4] = {
+    {0x00, 0x00, 0x00, 0x00}, {0xFF, 0xFF, 0xFF, 0xFF}, {0x5A, 0xC3, 0x0F, 0xF0}
+  };
+  for (unsigned first = 0; first < 256; ++first) {
+    for (const auto& tail : tails) {
+      std::vector<std::byte> bytes{static_cast<std::byte>(first)};
+      for (std::uint8_t b : tail) {
+        bytes.push_back(static_cast<std::byte>(b));
+      }
+      // followed by unrelated bytes, as inside a stream
+      bytes.resize(8, std::byte{0xA5});
+      for (std::size_t length = 1; length <= bytes.size(); ++length) {
+        compare(std::span(bytes).first(length));
+      }
+    }
+  }
+
+  constexpr std::size_t boundaries[][2] = {
+    {0, 1},          {0x3F, 1},       {0x40, 2},         {0x3FFF, 2},      {0x4000, 3},
+    {0x1FFFFF, 3},   {0x200000, 4},   {0xFFFFFFF, 4},    {0x10000000, 5},  {0xFFFFFFFF, 5},
+  };
+  for (const auto& [size, length] : boundaries) {
+    check_round_trip(size, length);
+  }
+
+  std::println("prefix check: {} failures", failures);
+  return failures == 0 ? 0 : 1;
+}
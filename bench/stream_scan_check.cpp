@@ -0,0 +1,140 @@
+#include <print>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "synthetic.hpp"
+
+import aggregate;
+import archive_index;
+import header;
+import stream_scan;
+
+// Checks that the zlib stream search rejects false headers: random bytes behind a valid header,
+// a header planted in the bytes between the replay header and the real stream, and a stream of
+// junk packets cut off before its trailer, which neither aggregation nor the archive index may
+// take for a segment.
+
+namespace {
+
+  int failures = 0;
+
+  // Random bytes without any 0x78, so the only candidate is the header at the start.
+  std::vector<std::byte> random_behind_header(std::uint32_t seed, std::size_t size) {
+    std::vector<std::byte> data{std::byte{0x78}, std::byte{0x9C}};
+    std::uint32_t state = seed;
+    while (data.size() < size) {
+      state = state * 1664525 + 1013904223;
+      auto b = static_cast<std::uint8_t>(state >> 24);
+      data.push_back(static_cast<std::byte>(b == 0x78 ? 0x79 : b));
+    }
+    return data;
+  }
+
+  // MPI packets whose object and message ids are both `fill` repeated, each behind its size prefix.
+  std::vector<std::byte> build_packets(std::size_t count, std::uint8_t fill) {
+    std::vector<std::byte> stream;
+    std::vector<std::byte> packet;
+    for (std::size_t i = 0; i < count; ++i) {
+      packet.assign(1, std::byte{4});
+      synthetic::append_le(packet, static_cast<std::uint32_t>(i * 40));
+      packet.resize(packet.size() + 16 + i % 32, static_cast<std::byte>(fill));
+      synthetic::append_size_prefix(stream, packet.size());
+      stream.insert(stream.end(), packet.begin(), packet.end());
+    }
+    return stream;
+  }
+
+  constexpr std::size_t real_packets = 100;
+  constexpr std::size_t junk_packets = 5;
+  static_assert(junk_packets < wrpl::min_damaged_segment_packets);
+
+  // A replay with one real segment, followed by a false header: the zlib stream of a few junk
+  // packets without its trailer. Returns where it was written.
+  std::filesystem::path write_replay_with_false_segment() {
+    std::string real = synthetic::deflate_stream(build_packets(real_packets, 0x11));
+    std::string junk = synthetic::deflate_stream(build_packets(junk_packets, 0x22));
+    junk.resize(junk.size() - 4);
+
+    std::filesystem::path path =
+      std::filesystem::temp_directory_path() / "wrpl_stream_scan_check.wrpl";
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    std::string header(wrpl::replay_header_size, '\0');
+    out << header << real << junk;
+    return path;
+  }
+
+  void check_aggregate(const std::filesystem::path& path) {
+    std::optional<std::vector<wrpl::group_by>> group_bys = wrpl::parse_group_bys("type");
+    wrpl::aggregate_result result = wrpl::aggregate_replays({path}, *group_bys);
+    std::uint64_t counted = 0;
+    for (const auto& [key, totals] : result.totals.rows(0)) {
+      counted += totals.packets;
+    }
+    if (counted != real_packets || !result.errors.empty()) {
+      std::println(stderr, "aggregate counted {} packets, expected {}", counted, real_packets);
+      failures++;
+    }
+  }
+
+  void check_archive_index(const std::filesystem::path& path) {
+    wrpl::archive_index index;
+    wrpl::index_update_stats stats = index.update({path});
+    std::optional<std::vector<std::uint32_t>> real = index.query({"msg:1111"});
+    std::optional<std::vector<std::uint32_t>> junk = index.query({"msg:2222"});
+    if (!stats.errors.empty() || !real || real->size() != 1 || !junk || !junk->empty()) {
+      std::println(stderr, "archive index took the junk stream for a segment");
+      failures++;
+    }
+  }
+
+} // namespace
+
+int main() {
+  constexpr std::uint32_t seeds = 2000;
+  for (std::uint32_t seed = 1; seed <= seeds; ++seed) {
+    std::vector<std::byte> data = random_behind_header(seed, 8 * 1024);
+    if (!wrpl::find_zlib_streams(data, 0).empty()) {
+      std::println(stderr, "seed {}: random bytes behind a header taken for a stream", seed);
+      failures++;
+    }
+  }
+
+  std::vector<std::byte> payload;
+  for (std::size_t i = 0; i < 64 * 1024; ++i) {
+    payload.push_back(static_cast<std::byte>('a' + i * 7 % 13));
+  }
+  std::string stream = synthetic::deflate_stream(payload);
+  std::vector<std::byte> file = random_behind_header(seeds + 1, 4 * 1024);
+  std::size_t stream_offset = file.size();
+  for (char c : stream) {
+    file.push_back(static_cast<std::byte>(c));
+  }
+
+  std::vector<std::size_t> visited;
+  wrpl::for_each_zlib_stream(file, 0, [&](std::size_t offset) -> std::uint64_t {
+    visited.push_back(offset);
+    return offset == stream_offset ? stream.size() : 0;
+  });
+  if (visited != std::vector<std::size_t>{stream_offset}) {
+    std::println(stderr, "expected only the stream at {}, got {} candidates", stream_offset,
+                 visited.size());
+    failures++;
+  }
+
+  std::filesystem::path replay = write_replay_with_false_segment();
+  check_aggregate(replay);
+  check_archive_index(replay);
+  std::error_code ec;
+  std::filesystem::remove(replay, ec);
+
+  std::println("stream scan check: {} failures", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+// Building blocks for the synthetic replays that wrpl_bench and the checks run on, and the
+// reference prefix decoder they compare against.
+namespace synthetic {
+
+  template <typename T>
+  void append_le(std::vector<std::byte>& out, T value) {
+    auto bits = std::bit_cast<std::array<std::byte, sizeof(T)>>(value);
+    if constexpr (std::endian::native == std::endian::big) {
+      std::ranges::reverse(bits);
+    }
+    out.insert(out.end(), bits.begin(), bits.end());
+  }
+
+  // The shortest form of a packet size prefix. 0b10xxxxxx holds six bits; 0b11xxxxxx is not a
+  // valid first byte. The 2 to 4 byte forms are big endian with a length marker bit, and larger
+  // sizes take a zero byte and a little endian uint32.
+  inline void append_size_prefix(std::vector<std::byte>& out, std::size_t size) {
+    if (size < 0x40) {
+      out.push_back(static_cast<std::byte>(0x80 | size));
+      return;
+    }
+    if (size >= 0x10000000) {
+      out.push_back(std::byte{0});
+      append_le(out, static_cast<std::uint32_t>(size));
+      return;
+    }
+    std::size_t length = size < 0x4000 ? 2 : size < 0x200000 ? 3 : 4;
+    constexpr std::size_t length_markers[] = {0, 0, 0x4000, 0x200000, 0x10000000};
+    std::size_t value = size | length_markers[length];
+    for (std::size_t i = length; i-- > 0;) {
+      out.push_back(static_cast<std::byte>((value >> (8 * i)) & 0xFF));
+    }
+  }
+
+  // Mirrors wrpl::variable_length_result, so the reference needs no module.
+  struct decoded_size_prefix {
+    std::int64_t payload_size;
+    std::size_t prefix_bytes_read;
+  };
+
+  // The size prefix decoder as it was before decode_size_prefix: one bounds checked read per
+  // prefix byte and a branch per length. Kept as the baseline for the prefix benchmark and the
+  // reference the prefix check compares decode_size_prefix with.
+  inline std::optional<decoded_size_prefix>
+  decode_size_prefix_reference(std::span<const std::byte> bytes) {
+    if (bytes.empty()) {
+      return std::nullopt;
+    }
+    auto byte_at = [&](std::size_t i) {
+      return static_cast<std::uint32_t>(bytes[i]);
+    };
+    std::uint32_t first_byte = byte_at(0);
+    if ((first_byte & 0x80) != 0) {
+      if ((first_byte & 0x40) != 0) {
+        return decoded_size_prefix{-1, 1};
+      }
+      return decoded_size_prefix{first_byte & 0x7F, 1};
+    }
+    if ((first_byte & 0x40) != 0) {
+      if (bytes.size() < 2) {
+        return std::nullopt;
+      }
+      return decoded_size_prefix{((first_byte << 8) | byte_at(1)) ^ 0x4000, 2};
+    }
+    if ((first_byte & 0x20) != 0) {
+      if (bytes.size() < 3) {
+        return std::nullopt;
+      }
+      return decoded_size_prefix{
+        ((first_byte << 16) | (byte_at(1) << 8) | byte_at(2)) ^ 0x200000, 3
+      };
+    }
+    if ((first_byte & 0x10) != 0) {
+      if (bytes.size() < 4) {
+        return std::nullopt;
+      }
+      return decoded_size_prefix{
+        ((first_byte << 24) | (byte_at(1) << 16) | (byte_at(2) << 8) | byte_at(3)) ^ 0x10000000, 4
+      };
+    }
+    if (bytes.size() < 5) {
+      return std::nullopt;
+    }
+    return decoded_size_prefix{
+      byte_at(1) | (byte_at(2) << 8) | (byte_at(3) << 16) | (byte_at(4) << 24), 5
+    };
+  }
+
+  // A zlib stream of `data`, or an empty string if compressing failed.
+  inline std::string deflate_stream(std::span<const std::byte> data) {
+    uLongf compressed_size = compressBound(static_cast<uLong>(data.size()));
+    std::string compressed(compressed_size, '\0');
+    int ret = compress2(
+      reinterpret_cast<Bytef*>(compressed.data()), &compressed_size,
+      reinterpret_cast<const Bytef*>(data.data()), static_cast<uLong>(data.size()),
+      Z_DEFAULT_COMPRESSION
+    );
+    if (ret != Z_OK) {
+      return {};
+    }
+    compressed.resize(compressed_size);
+    return compressed;
+  }
+
+} // namespace synthetic
@@ -0,0 +1,49 @@
+// Compares parseReplayColumns throughput of wasm builds on one replay:
+//   node bench/wasm_bench.mjs <replay.wrpl> <wrpl_wasm.js> [wrpl_wasm_mt.js] [iterations]
+import { readFileSync } from "node:fs";
+import { createRequire } from "node:module";
+import { resolve } from "node:path";
+
+const require = createRequire(import.meta.url);
+
+function load(path) {
+  const module = require(resolve(path));
+  return new Promise((ready) => {
+    if (module.calledRun) {
+      ready(module);
+    } else {
+      module.onRuntimeInitialized = () => ready(module);
+    }
+  });
+}
+
+async function run(path, replay, iterations) {
+  const module = await load(path);
+  let best = Infinity;
+  let packets = 0;
+  for (let i = 0; i < iterations; i++) {
+    const start = performance.now();
+    const parser = module.parseReplayColumns(replay);
+    best = Math.min(best, performance.now() - start);
+    packets = parser.packetCount();
+    if (parser.error()) {
+      console.error(`${path}: ${parser.error()}`);
+    }
+    parser.delete();
+  }
+  const mbPerSecond = replay.length / (1024 * 1024) / (best / 1000);
+  console.log(`${path}: ${best.toFixed(2)} ms, ${mbPerSecond.toFixed(1)} MB/s, ${packets} packets`);
+}
+
+const [replayPath, ...rest] = process.argv.slice(2);
+const iterations = /^\d+$/.test(rest.at(-1) ?? "") ? Number(rest.pop()) : 5;
+if (!replayPath || rest.length === 0) {
+  console.error("usage: node wasm_bench.mjs <replay.wrpl> <wrpl_wasm.js>... [iterations]");
+  process.exit(1);
+}
+
+const replay = new Uint8Array(readFileSync(replayPath));
+for (const build of rest) {
+  await run(build, replay, iterations);
+}
+process.exit(0);
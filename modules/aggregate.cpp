@@ -0,0 +1,386 @@
+module;
+
+#include <print>
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "packets.hpp"
+
+export module aggregate;
+
+import deserializer;
+import header;
+import parser;
+import stream_scan;
+import trace;
+
+namespace wrpl {
+
+  // The dimensions one table is keyed on. Message and object ids only exist for MPI packets, so a
+  // group-by that uses either of them skips every other packet.
+  export struct group_by {
+    bool type = false;
+    bool message = false;
+    bool object = false;
+    // width of a time bucket; 0 leaves time out of the key
+    std::uint32_t bucket_ms = 0;
+
+    bool needs_mpi() const {
+      return message || object;
+    }
+
+    std::string label() const {
+      std::string text;
+      auto append = [&](std::string_view part) {
+        if (!text.empty()) {
+          text += '+';
+        }
+        text += part;
+      };
+      if (type) {
+        append("type");
+      }
+      if (message) {
+        append("msg");
+      }
+      if (object) {
+        append("obj");
+      }
+      if (bucket_ms != 0) {
+        append(std::format("t={}", bucket_ms));
+      }
+      return text;
+    }
+  };
+
+  // Parses whitespace separated group-bys such as `type msg obj+msg t=1000`. Dimensions of one
+  // group-by are joined with '+'; `t=<ms>` buckets timestamps.
+  export std::optional<std::vector<group_by>> parse_group_bys(std::string_view expression) {
+    std::vector<group_by> group_bys;
+    auto next_token = [](std::string_view& text, char delimiter) {
+      std::size_t end = text.find(delimiter);
+      std::string_view token = text.substr(0, end);
+      text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+      return token;
+    };
+
+    while (!expression.empty()) {
+      std::string_view term = next_token(expression, ' ');
+      if (term.empty()) {
+        continue;
+      }
+      group_by group;
+      while (!term.empty()) {
+        std::string_view dimension = next_token(term, '+');
+        if (dimension == "type") {
+          group.type = true;
+        } else if (dimension == "msg") {
+          group.message = true;
+        } else if (dimension == "obj") {
+          group.object = true;
+        } else if (dimension.starts_with("t=")) {
+          std::string_view width = dimension.substr(2);
+          auto [ptr, ec] =
+            std::from_chars(width.data(), width.data() + width.size(), group.bucket_ms);
+          if (ec != std::errc{} || ptr != width.data() + width.size() || group.bucket_ms == 0) {
+            return std::nullopt;
+          }
+        } else {
+          return std::nullopt;
+        }
+      }
+      group_bys.push_back(group);
+    }
+    if (group_bys.empty()) {
+      return std::nullopt;
+    }
+    return group_bys;
+  }
+
+  // Dimensions a group-by does not use stay zero.
+  export struct group_key {
+    std::uint32_t bucket = 0;
+    std::uint16_t message_id = 0;
+    std::uint16_t object_id = 0;
+    std::uint8_t type = 0;
+
+    bool operator==(const group_key&) const = default;
+
+    auto operator<=>(const group_key& other) const {
+      return std::tie(bucket, type, message_id, object_id) <=>
+             std::tie(other.bucket, other.type, other.message_id, other.object_id);
+    }
+  };
+
+  struct group_key_hash {
+    std::size_t operator()(const group_key& key) const {
+      std::uint64_t packed = (std::uint64_t{key.bucket} << 32) ^
+                             (std::uint64_t{key.type} << 40) ^
+                             (std::uint64_t{key.message_id} << 16) ^ key.object_id;
+      return std::hash<std::uint64_t>{}(packed * 0x9E3779B97F4A7C15ull);
+    }
+  };
+
+  export struct group_totals {
+    std::uint64_t packets = 0;
+    std::uint64_t bytes = 0;
+  };
+
+  // Accumulates every configured group-by in one pass over the packets. Each thread feeds its own
+  // aggregator and the results are merged afterwards, so adding a packet never takes a lock.
+  export class aggregator {
+public:
+    explicit aggregator(std::vector<group_by> group_bys) :
+        group_bys_{std::move(group_bys)}, tables_(group_bys_.size()) {
+    }
+
+    void add(const packet_view& packet) {
+      if (!packet.header) {
+        return;
+      }
+      std::uint8_t type_val = packet.header->packet_type_val;
+      std::optional<mpi_message> mpi;
+      bool mpi_read = false;
+      for (std::size_t i = 0; i < group_bys_.size(); ++i) {
+        const group_by& group = group_bys_[i];
+        if (group.needs_mpi()) {
+          if (!mpi_read) {
+            mpi_read = true;
+            if (static_cast<packet_type>(type_val) == packet_type::mpi) {
+              mpi = read_mpi_message(packet.payload());
+            }
+          }
+          if (!mpi) {
+            continue;
+          }
+        }
+        group_key key;
+        if (group.bucket_ms != 0) {
+          key.bucket = packet.header->timestamp_ms / group.bucket_ms;
+        }
+        if (group.type) {
+          key.type = type_val;
+        }
+        if (group.message) {
+          key.message_id = mpi->message_id;
+        }
+        if (group.object) {
+          key.object_id = mpi->object_id;
+        }
+        group_totals& totals = tables_[i][key];
+        totals.packets++;
+        totals.bytes += packet.data.size();
+      }
+    }
+
+    // `other` must have been built from the same group-bys.
+    void merge(const aggregator& other) {
+      for (std::size_t i = 0; i < tables_.size(); ++i) {
+        for (const auto& [key, totals] : other.tables_[i]) {
+          group_totals& merged = tables_[i][key];
+          merged.packets += totals.packets;
+          merged.bytes += totals.bytes;
+        }
+      }
+    }
+
+    const std::vector<group_by>& group_bys() const {
+      return group_bys_;
+    }
+
+    // The rows of one group-by, ordered by key.
+    std::vector<std::pair<group_key, group_totals>> rows(std::size_t group) const {
+      std::vector<std::pair<group_key, group_totals>> result(
+        tables_[group].begin(), tables_[group].end()
+      );
+      std::ranges::sort(result, {}, &std::pair<group_key, group_totals>::first);
+      return result;
+    }
+
+private:
+    std::vector<group_by> group_bys_;
+    std::vector<std::unordered_map<group_key, group_totals, group_key_hash>> tables_;
+  };
+
+  export struct aggregate_result {
+    aggregator totals;
+    // one line per replay that could not be read or framed to the end
+    std::vector<std::string> errors;
+  };
+
+  // Frames every segment of one replay into `totals`. Packets framed before an error still count,
+  // and a damaged segment does not hide the ones after it. Each candidate is tallied on its own
+  // first, so a false header that frames a few junk packets adds nothing.
+  std::optional<std::string> aggregate_replay(
+    const std::filesystem::path& path, const packet_filter& filter, aggregator& totals
+  ) {
+    trace_span span("aggregate replay");
+    std::optional<std::vector<std::byte>> data = read_replay_file(path);
+    if (!data) {
+      return std::format("{}: could not read file", path.string());
+    }
+    std::size_t segments = 0;
+    std::optional<std::string> error;
+    for_each_zlib_stream(*data, replay_header_size, [&](std::size_t offset) -> std::uint64_t {
+      std::span<const std::byte> compressed = std::span<const std::byte>(*data).subspan(offset);
+      memory_istream stream(compressed);
+      packet_framer framer(stream, filter);
+      aggregator segment(totals.group_bys());
+      std::uint64_t framed = 0;
+      auto packet = framer.next_view();
+      for (; packet && *packet; packet = framer.next_view()) {
+        segment.add(**packet);
+        framed++;
+      }
+      // packets the filter skipped were framed too
+      if (!is_segment(framer.stream_complete(), framed + framer.skipped_packets())) {
+        return 0;
+      }
+      totals.merge(segment);
+      segments++;
+      if (!packet) {
+        if (!error) {
+          error = std::format("{}: {}", path.string(), packet.error().message());
+        }
+        return zlib_stream_extent(compressed).compressed_size;
+      }
+      return framer.compressed_consumed();
+    });
+    if (segments == 0) {
+      return std::format("{}: zlib stream not found", path.string());
+    }
+    return error;
+  }
+
+  // Aggregates a batch of replays on all cores: workers take whole replays and keep private
+  // tables that are merged once every worker is done. The segments of one replay stay on one
+  // worker, since where one stream ends decides which later candidates are real.
+  export aggregate_result aggregate_replays(
+    const std::vector<std::filesystem::path>& paths, const std::vector<group_by>& group_bys,
+    const packet_filter& filter = {}
+  ) {
+    std::size_t worker_count = std::clamp<std::size_t>(
+      std::thread::hardware_concurrency(), 1, std::max<std::size_t>(paths.size(), 1)
+    );
+    std::vector<aggregator> partials(worker_count, aggregator(group_bys));
+    std::vector<std::optional<std::string>> errors(paths.size());
+    std::atomic<std::size_t> next_path{0};
+    {
+      std::vector<std::jthread> workers;
+      for (std::size_t w = 0; w < worker_count; ++w) {
+        workers.emplace_back([&, w] {
+          for (std::size_t i = next_path++; i < paths.size(); i = next_path++) {
+            errors[i] = aggregate_replay(paths[i], filter, partials[w]);
+          }
+        });
+      }
+    }
+
+    aggregate_result result{aggregator(group_bys)};
+    for (const aggregator& partial : partials) {
+      result.totals.merge(partial);
+    }
+    for (std::optional<std::string>& error : errors) {
+      if (error) {
+        result.errors.push_back(std::move(*error));
+      }
+    }
+    return result;
+  }
+
+  std::string packet_type_label(std::uint8_t type_val) {
+    if (std::optional<std::string_view> name = get_packet_type_name(type_val)) {
+      return std::string(*name);
+    }
+    return std::to_string(type_val);
+  }
+
+  // One compact table per group-by, or with `json` one JSON object per row.
+  export void print_aggregates(const aggregator& totals, bool json) {
+    trace_span span("print aggregates");
+    const std::vector<group_by>& group_bys = totals.group_bys();
+    for (std::size_t i = 0; i < group_bys.size(); ++i) {
+      const group_by& group = group_bys[i];
+      std::vector<std::pair<group_key, group_totals>> rows = totals.rows(i);
+      std::string label = group.label();
+
+      if (json) {
+        for (const auto& [key, sums] : rows) {
+          std::print(R"({{"group":"{}")", label);
+          if (group.bucket_ms != 0) {
+            std::print(R"(,"t":{})", std::uint64_t{key.bucket} * group.bucket_ms);
+          }
+          if (group.type) {
+            std::print(R"(,"type":"{}")", packet_type_label(key.type));
+          }
+          if (group.message) {
+            std::print(R"(,"message_id":{})", key.message_id);
+            if (std::optional<std::string_view> name = packet_ids::get_name(key.message_id)) {
+              std::print(R"(,"message":"{}")", *name);
+            }
+          }
+          if (group.object) {
+            std::print(R"(,"object_id":{})", key.object_id);
+          }
+          std::println(R"(,"packets":{},"bytes":{}}})", sums.packets, sums.bytes);
+        }
+        continue;
+      }
+
+      std::println("{}{} ({} groups)", i == 0 ? "" : "\n", label, rows.size());
+      std::string heading;
+      if (group.bucket_ms != 0) {
+        heading += std::format("{:>10}  ", "t");
+      }
+      if (group.type) {
+        heading += std::format("{:<20}", "type");
+      }
+      if (group.message) {
+        heading += std::format("{:<55}", "msg");
+      }
+      if (group.object) {
+        heading += std::format("{:<8}", "obj");
+      }
+      std::println("{}{:>12} {:>14}", heading, "packets", "bytes");
+
+      for (const auto& [key, sums] : rows) {
+        std::string line;
+        if (group.bucket_ms != 0) {
+          line += std::format("{:>10}  ", std::uint64_t{key.bucket} * group.bucket_ms);
+        }
+        if (group.type) {
+          line += std::format("{:<20}", packet_type_label(key.type));
+        }
+        if (group.message) {
+          line += std::format(
+            "0x{:04X} {:<48}", key.message_id, packet_ids::get_name(key.message_id).value_or("")
+          );
+        }
+        if (group.object) {
+          line += std::format("0x{:04X}  ", key.object_id);
+        }
+        std::println("{}{:>12} {:>14}", line, sums.packets, sums.bytes);
+      }
+    }
+  }
+
+} // namespace wrpl
@@ -0,0 +1,587 @@
+module;
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <bitset>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "packets.hpp"
+
+export module archive_index;
+
+import deserializer;
+import header;
+import object_index;
+import parser;
+import stream_scan;
+import trace;
+
+namespace wrpl {
+
+  // What one replay contributes to the archive index. Terms are spelled `kind:value`, e.g.
+  // `sender:Name`, `msg:F058` or `level:levels/avg_stalingrad.bin`.
+  struct replay_terms {
+    std::vector<std::string> terms;
+    std::vector<std::uint16_t> object_ids;
+  };
+
+  std::string message_term(std::uint16_t message_id) {
+    return std::format("msg:{:04X}", message_id);
+  }
+
+  std::expected<replay_terms, std::string> collect_terms(const std::filesystem::path& path) {
+    trace_span span("index replay");
+    std::optional<std::vector<std::byte>> data = read_replay_file(path);
+    if (!data) {
+      return std::unexpected("could not read file");
+    }
+
+    replay_terms result;
+    if (std::optional<replay_header> header = parse_replay_header(*data)) {
+      auto add = [&](std::string_view kind, std::string_view value) {
+        if (!value.empty()) {
+          result.terms.push_back(std::format("{}:{}", kind, value));
+        }
+      };
+      add("level", header->level);
+      add("location", header->location_name);
+      add("battle_type", header->battle_type);
+      add("battle_class", header->battle_class);
+      add("environment", header->environment);
+      result.terms.push_back(std::format("session:{:x}", header->session_id));
+    }
+
+    packet_filter chat_and_mpi;
+    chat_and_mpi.types.set(static_cast<std::uint8_t>(packet_type::chat));
+    chat_and_mpi.types.set(static_cast<std::uint8_t>(packet_type::mpi));
+    chat_and_mpi.filter_types = true;
+
+    std::bitset<0x10000> message_ids;
+    std::bitset<0x10000> object_ids;
+    std::vector<std::string> senders;
+    // terms of the current candidate, kept apart until it turns out to be a segment
+    std::bitset<0x10000> segment_message_ids;
+    std::bitset<0x10000> segment_object_ids;
+    std::vector<std::string> segment_senders;
+    std::string sender_name;
+    std::string message;
+    std::size_t segments = 0;
+    for_each_zlib_stream(*data, replay_header_size, [&](std::size_t offset) -> std::uint64_t {
+      std::span<const std::byte> compressed = std::span<const std::byte>(*data).subspan(offset);
+      memory_istream stream(compressed);
+      packet_framer framer(stream, chat_and_mpi);
+      segment_message_ids.reset();
+      segment_object_ids.reset();
+      segment_senders.clear();
+      std::uint64_t framed = 0;
+      // a truncated segment still contributes what was framed before the damage
+      auto packet = framer.next_view();
+      for (; packet && *packet; packet = framer.next_view()) {
+        framed++;
+        const packet_view& view = **packet;
+        if (!view.header) {
+          continue;
+        }
+        if (static_cast<packet_type>(view.header->packet_type_val) == packet_type::chat) {
+          if (deserialize_chat_into(view.payload(), sender_name, message) &&
+              std::ranges::find(segment_senders, sender_name) == segment_senders.end()) {
+            segment_senders.push_back(sender_name);
+          }
+        } else if (std::optional<mpi_message> mpi = read_mpi_message(view.payload())) {
+          segment_message_ids.set(mpi->message_id);
+          segment_object_ids.set(mpi->object_id);
+        }
+      }
+      // packets the filter skipped were framed too
+      if (!is_segment(framer.stream_complete(), framed + framer.skipped_packets())) {
+        return 0;
+      }
+      segments++;
+      message_ids |= segment_message_ids;
+      object_ids |= segment_object_ids;
+      for (std::string& sender : segment_senders) {
+        if (std::ranges::find(senders, sender) == senders.end()) {
+          senders.push_back(std::move(sender));
+        }
+      }
+      return packet ? framer.compressed_consumed()
+                    : zlib_stream_extent(compressed).compressed_size;
+    });
+    if (segments == 0) {
+      return std::unexpected("zlib stream not found");
+    }
+
+    for (const std::string& sender : senders) {
+      result.terms.push_back("sender:" + sender);
+    }
+    for (std::size_t id = 0; id < message_ids.size(); ++id) {
+      if (message_ids.test(id)) {
+        result.terms.push_back(message_term(static_cast<std::uint16_t>(id)));
+      }
+      if (object_ids.test(id)) {
+        result.object_ids.push_back(static_cast<std::uint16_t>(id));
+      }
+    }
+    std::ranges::sort(result.terms);
+    auto duplicates = std::ranges::unique(result.terms);
+    result.terms.erase(duplicates.begin(), duplicates.end());
+    return result;
+  }
+
+  // Bloom filter over the object ids of one replay. A replay addresses thousands of objects, so
+  // giving each id a posting list would dominate the index; `obj:` queries test every replay's
+  // filter instead. At 10 bits per id and 7 probes about 1% of the reported replays are false.
+  class object_bloom {
+public:
+    object_bloom() = default;
+
+    explicit object_bloom(std::span<const std::uint16_t> object_ids) {
+      std::size_t bits = std::bit_ceil(std::max<std::size_t>(64, object_ids.size() * 10));
+      words_.resize(bits / 64);
+      for (std::uint16_t object_id : object_ids) {
+        for_each_bit(object_id, [&](std::size_t bit) {
+          words_[bit / 64] |= std::uint64_t{1} << (bit % 64);
+        });
+      }
+    }
+
+    explicit object_bloom(std::vector<std::uint64_t> words) : words_{std::move(words)} {
+    }
+
+    bool may_contain(std::uint16_t object_id) const {
+      if (words_.empty()) {
+        return false;
+      }
+      bool present = true;
+      for_each_bit(object_id, [&](std::size_t bit) {
+        present = present && (words_[bit / 64] >> (bit % 64) & 1) != 0;
+      });
+      return present;
+    }
+
+    const std::vector<std::uint64_t>& words() const {
+      return words_;
+    }
+
+private:
+    static constexpr int probe_count = 7;
+
+    std::vector<std::uint64_t> words_;
+
+    // double hashing over one 64-bit mix of the id
+    template <typename F>
+    void for_each_bit(std::uint16_t object_id, F&& f) const {
+      std::uint64_t hash = (object_id + 0x9E3779B97F4A7C15ull) * 0xBF58476D1CE4E5B9ull;
+      hash ^= hash >> 31;
+      auto h1 = static_cast<std::uint32_t>(hash);
+      auto h2 = static_cast<std::uint32_t>(hash >> 32) | 1;
+      std::size_t mask = words_.size() * 64 - 1;
+      for (int i = 0; i < probe_count; ++i) {
+        f((h1 + static_cast<std::uint32_t>(i) * h2) & mask);
+      }
+    }
+  };
+
+  export struct index_update_stats {
+    std::size_t added = 0;
+    std::size_t updated = 0;
+    std::size_t removed = 0;
+    std::size_t unchanged = 0;
+    std::vector<std::string> errors;
+  };
+
+  // Inverted index over an archive of replays: each term maps to the sorted ids of the replays
+  // containing it, stored as varint deltas. Object ids go to per-replay Bloom filters instead.
+  // Replays are identified by absolute path, size and modification time, so an update only
+  // parses files that are new or changed and drops entries whose file is gone.
+  export class archive_index {
+public:
+    static constexpr std::uint32_t MAGIC = 0x58494157; // "WAIX"
+
+    std::size_t replay_count() const {
+      return replays_.size();
+    }
+
+    std::size_t term_count() const {
+      return postings_.size();
+    }
+
+    const std::string& path(std::uint32_t replay_id) const {
+      return replays_[replay_id].path;
+    }
+
+    // Indexes `files` on all cores. Entries of files that are not listed stay as long as the
+    // file exists, so new arrivals can be added without naming the whole archive; those that
+    // changed since they were indexed are parsed again.
+    index_update_stats update(const std::vector<std::filesystem::path>& files) {
+      index_update_stats stats;
+
+      std::unordered_map<std::string, std::uint32_t> known;
+      for (std::uint32_t id = 0; id < replays_.size(); ++id) {
+        known.emplace(replays_[id].path, id);
+      }
+      std::vector<bool> keep(replays_.size(), false);
+      std::vector<indexed_replay> pending;
+      for (std::uint32_t id = 0; id < replays_.size(); ++id) {
+        std::optional<file_identity> current = identify(replays_[id].path);
+        keep[id] = current && current->size == replays_[id].size &&
+                   current->modified == replays_[id].modified;
+        // a changed file is parsed again whether or not this run lists it
+        if (current && !keep[id]) {
+          stats.updated++;
+          known[replays_[id].path] = no_replay;
+          pending.push_back({replays_[id].path, current->size, current->modified, {}});
+        }
+      }
+
+      for (const std::filesystem::path& file : files) {
+        std::string path = std::filesystem::absolute(file).lexically_normal().string();
+        auto it = known.find(path);
+        if (it != known.end() && it->second == no_replay) {
+          continue; // listed twice, or changed and already pending
+        }
+        if (it != known.end() && keep[it->second]) {
+          stats.unchanged++;
+          continue;
+        }
+        std::optional<file_identity> identity = identify(path);
+        if (!identity) {
+          stats.errors.push_back(std::format("{}: could not stat file", path));
+          continue;
+        }
+        (it == known.end() ? stats.added : stats.updated)++;
+        known[path] = no_replay;
+        pending.push_back({path, identity->size, identity->modified, {}});
+      }
+
+      std::vector<std::expected<replay_terms, std::string>> collected(
+        pending.size(), std::unexpected(std::string())
+      );
+      std::atomic<std::size_t> next_file{0};
+      {
+        std::size_t worker_count = std::clamp<std::size_t>(
+          std::thread::hardware_concurrency(), 1, std::max<std::size_t>(pending.size(), 1)
+        );
+        std::vector<std::jthread> workers;
+        for (std::size_t w = 0; w < worker_count; ++w) {
+          workers.emplace_back([&] {
+            for (std::size_t i = next_file++; i < pending.size(); i = next_file++) {
+              collected[i] = collect_terms(pending[i].path);
+            }
+          });
+        }
+      }
+
+      // surviving replays keep their relative order, so remapped posting lists stay sorted
+      std::vector<std::uint32_t> remap(replays_.size(), no_replay);
+      std::vector<indexed_replay> replays;
+      for (std::uint32_t id = 0; id < replays_.size(); ++id) {
+        if (keep[id]) {
+          remap[id] = static_cast<std::uint32_t>(replays.size());
+          replays.push_back(std::move(replays_[id]));
+        } else {
+          stats.removed++;
+        }
+      }
+      stats.removed -= stats.updated;
+
+      std::map<std::string, posting_list, std::less<>> postings;
+      for (auto& [term, list] : postings_) {
+        posting_list remapped;
+        for (std::uint32_t id : list.decode()) {
+          if (remap[id] != no_replay) {
+            remapped.append(remap[id]);
+          }
+        }
+        if (remapped.count > 0) {
+          postings.emplace(term, std::move(remapped));
+        }
+      }
+
+      for (std::size_t i = 0; i < pending.size(); ++i) {
+        if (!collected[i]) {
+          stats.errors.push_back(std::format("{}: {}", pending[i].path, collected[i].error()));
+          continue;
+        }
+        auto id = static_cast<std::uint32_t>(replays.size());
+        pending[i].objects = object_bloom(collected[i]->object_ids);
+        replays.push_back(std::move(pending[i]));
+        for (const std::string& term : collected[i]->terms) {
+          postings[term].append(id);
+        }
+      }
+
+      replays_ = std::move(replays);
+      postings_ = std::move(postings);
+      return stats;
+    }
+
+    // Replays containing every term. `msg:` takes a catalog name or a hex id; `obj:<hex id>` is
+    // answered from the Bloom filters and may include a few replays without the object.
+    std::optional<std::vector<std::uint32_t>> query(const std::vector<std::string>& terms) const {
+      std::optional<std::vector<std::uint32_t>> matches;
+      std::vector<std::uint16_t> object_ids;
+      for (const std::string& raw : terms) {
+        std::string_view term = raw;
+        if (term.starts_with("obj:")) {
+          std::optional<std::uint16_t> object_id = parse_hex_id(term.substr(4));
+          if (!object_id) {
+            return std::nullopt;
+          }
+          object_ids.push_back(*object_id);
+          continue;
+        }
+
+        std::string normalized(term);
+        if (term.starts_with("msg:")) {
+          std::string_view value = term.substr(4);
+          std::optional<std::uint16_t> message_id = packet_ids::find_id(value);
+          if (!message_id) {
+            message_id = parse_hex_id(value);
+          }
+          if (!message_id) {
+            return std::nullopt;
+          }
+          normalized = message_term(*message_id);
+        }
+
+        auto it = postings_.find(normalized);
+        std::vector<std::uint32_t> ids = it == postings_.end()
+                                           ? std::vector<std::uint32_t>{}
+                                           : it->second.decode();
+        if (matches) {
+          std::vector<std::uint32_t> both;
+          std::ranges::set_intersection(*matches, ids, std::back_inserter(both));
+          ids = std::move(both);
+        }
+        matches = std::move(ids);
+      }
+
+      if (!matches) {
+        matches.emplace(replays_.size());
+        for (std::uint32_t id = 0; id < replays_.size(); ++id) {
+          (*matches)[id] = id;
+        }
+      }
+      std::erase_if(*matches, [&](std::uint32_t id) {
+        return !std::ranges::all_of(object_ids, [&](std::uint16_t object_id) {
+          return replays_[id].objects.may_contain(object_id);
+        });
+      });
+      return matches;
+    }
+
+    std::vector<std::byte> serialize() const {
+      std::vector<std::byte> out;
+      write_varint(out, MAGIC);
+      write_varint(out, replays_.size());
+      for (const indexed_replay& replay : replays_) {
+        write_string(out, replay.path);
+        write_varint(out, replay.size);
+        write_varint(out, zigzag_encode(replay.modified));
+        write_varint(out, replay.objects.words().size());
+        for (std::uint64_t word : replay.objects.words()) {
+          for (int shift = 0; shift < 64; shift += 8) {
+            out.push_back(static_cast<std::byte>(word >> shift));
+          }
+        }
+      }
+      write_varint(out, postings_.size());
+      for (const auto& [term, list] : postings_) {
+        write_string(out, term);
+        write_varint(out, list.count);
+        write_varint(out, list.encoded.size());
+        out.insert(out.end(), list.encoded.begin(), list.encoded.end());
+      }
+      return out;
+    }
+
+    static std::optional<archive_index> deserialize(std::span<const std::byte> data) {
+      std::size_t pos = 0;
+      std::optional<std::uint64_t> magic = read_varint(data, pos);
+      std::optional<std::uint64_t> replay_count = read_varint(data, pos);
+      if (!magic || *magic != MAGIC || !replay_count) {
+        return std::nullopt;
+      }
+
+      archive_index index;
+      for (std::uint64_t i = 0; i < *replay_count; ++i) {
+        std::optional<std::string> path = read_string(data, pos);
+        std::optional<std::uint64_t> size = read_varint(data, pos);
+        std::optional<std::uint64_t> modified = read_varint(data, pos);
+        std::optional<std::uint64_t> word_count = read_varint(data, pos);
+        // filters are a power of two words, since probes mask the bit position
+        if (!path || !size || !modified || !word_count || !std::has_single_bit(*word_count) ||
+            *word_count > (data.size() - pos) / 8) {
+          return std::nullopt;
+        }
+        std::vector<std::uint64_t> words(*word_count);
+        for (std::uint64_t& word : words) {
+          for (int shift = 0; shift < 64; shift += 8) {
+            word |= std::uint64_t{static_cast<std::uint8_t>(data[pos++])} << shift;
+          }
+        }
+        index.replays_.push_back(
+          {std::move(*path), *size, zigzag_decode(*modified), object_bloom(std::move(words))}
+        );
+      }
+
+      std::optional<std::uint64_t> term_count = read_varint(data, pos);
+      if (!term_count) {
+        return std::nullopt;
+      }
+      for (std::uint64_t i = 0; i < *term_count; ++i) {
+        std::optional<std::string> term = read_string(data, pos);
+        std::optional<std::uint64_t> count = read_varint(data, pos);
+        std::optional<std::uint64_t> encoded_size = read_varint(data, pos);
+        if (!term || !count || !encoded_size || *encoded_size > data.size() - pos) {
+          return std::nullopt;
+        }
+        posting_list list;
+        std::span<const std::byte> encoded = data.subspan(pos, *encoded_size);
+        list.encoded.assign(encoded.begin(), encoded.end());
+        list.count = static_cast<std::uint32_t>(*count);
+        pos += *encoded_size;
+        std::vector<std::uint32_t> ids = list.decode();
+        if (ids.size() != list.count ||
+            (!ids.empty() && ids.back() >= index.replays_.size())) {
+          return std::nullopt;
+        }
+        list.last = ids.empty() ? 0 : ids.back();
+        index.postings_.emplace(std::move(*term), std::move(list));
+      }
+      return index;
+    }
+
+private:
+    static constexpr std::uint32_t no_replay = 0xFFFFFFFF;
+
+    struct indexed_replay {
+      std::string path;
+      std::uint64_t size = 0;
+      std::int64_t modified = 0;
+      object_bloom objects;
+    };
+
+    struct file_identity {
+      std::uint64_t size;
+      std::int64_t modified;
+    };
+
+    // Replay ids in ascending order, each stored as the varint delta to the previous one.
+    struct posting_list {
+      std::vector<std::byte> encoded;
+      std::uint32_t count = 0;
+      std::uint32_t last = 0;
+
+      void append(std::uint32_t id) {
+        write_varint(encoded, count == 0 ? id : id - last);
+        last = id;
+        count++;
+      }
+
+      std::vector<std::uint32_t> decode() const {
+        std::vector<std::uint32_t> ids;
+        ids.reserve(count);
+        std::size_t pos = 0;
+        std::uint32_t id = 0;
+        for (std::uint32_t i = 0; i < count; ++i) {
+          std::optional<std::uint64_t> delta = read_varint(encoded, pos);
+          if (!delta) {
+            break;
+          }
+          id += static_cast<std::uint32_t>(*delta);
+          ids.push_back(id);
+        }
+        return ids;
+      }
+    };
+
+    std::vector<indexed_replay> replays_;
+    // ordered, so the serialized index is the same for the same archive
+    std::map<std::string, posting_list, std::less<>> postings_;
+
+    static std::optional<file_identity> identify(const std::filesystem::path& path) {
+      std::error_code ec;
+      std::uint64_t size = std::filesystem::file_size(path, ec);
+      if (ec) {
+        return std::nullopt;
+      }
+      std::filesystem::file_time_type modified = std::filesystem::last_write_time(path, ec);
+      if (ec) {
+        return std::nullopt;
+      }
+      return file_identity{size, static_cast<std::int64_t>(modified.time_since_epoch().count())};
+    }
+
+    static std::optional<std::uint16_t> parse_hex_id(std::string_view text) {
+      if (text.starts_with("0x") || text.starts_with("0X")) {
+        text.remove_prefix(2);
+      }
+      std::uint16_t value = 0;
+      auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value, 16);
+      if (ec != std::errc{} || ptr != text.data() + text.size()) {
+        return std::nullopt;
+      }
+      return value;
+    }
+
+    static void write_string(std::vector<std::byte>& out, std::string_view text) {
+      write_varint(out, text.size());
+      auto bytes = std::as_bytes(std::span(text));
+      out.insert(out.end(), bytes.begin(), bytes.end());
+    }
+
+    static std::optional<std::string>
+    read_string(std::span<const std::byte> data, std::size_t& pos) {
+      std::optional<std::uint64_t> size = read_varint(data, pos);
+      if (!size || *size > data.size() - pos) {
+        return std::nullopt;
+      }
+      std::string text(reinterpret_cast<const char*>(data.data() + pos), *size);
+      pos += *size;
+      return text;
+    }
+  };
+
+  // Expands directories to the .wrpl files below them; other paths are taken as they are.
+  export std::vector<std::filesystem::path> find_replay_files(
+    const std::vector<std::filesystem::path>& paths
+  ) {
+    std::vector<std::filesystem::path> files;
+    for (const std::filesystem::path& path : paths) {
+      std::error_code ec;
+      if (!std::filesystem::is_directory(path, ec)) {
+        files.push_back(path);
+        continue;
+      }
+      for (auto it = std::filesystem::recursive_directory_iterator(path, ec);
+           !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        if (it->is_regular_file(ec) && it->path().extension() == ".wrpl") {
+          files.push_back(it->path());
+        }
+      }
+    }
+    std::ranges::sort(files);
+    return files;
+  }
+
+} // namespace wrpl
@@ -1,14 +1,376 @@
 #include <emscripten/bind.h>
-#include <sstream>
+#include <emscripten/val.h>
+#include <zlib.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
+import deserializer;
+import header;
 import parser;
+import stream_scan;
 
 void parse_replay(const std::string& data) {
-    std::stringstream ss(data);
-    wrpl::process_stream(ss);
+    wrpl::memory_istream stream(std::as_bytes(std::span(data)));
+    wrpl::process_stream(stream);
+}
+
+// One column per packet field, so JS reads them as typed arrays over wasm memory instead of
+// receiving an object per packet. Payloads are concatenated and located by offset and size.
+struct packet_columns {
+    std::vector<std::uint32_t> timestamp_ms;
+    std::vector<std::uint8_t> type;
+    std::vector<std::uint16_t> object_id;
+    std::vector<std::uint16_t> message_id;
+    std::vector<std::uint32_t> payload_offset;
+    std::vector<std::uint32_t> payload_size;
+    std::vector<std::uint8_t> payloads;
+
+    // packets without an MPI header get this object and message id
+    static constexpr std::uint16_t no_id = 0xFFFF;
+
+    void append(const wrpl::packet_view& packet) {
+        std::span<const std::byte> payload = packet.payload();
+        std::uint8_t type_val = packet.header ? packet.header->packet_type_val : 0;
+        std::optional<wrpl::mpi_message> mpi;
+        if (static_cast<wrpl::packet_type>(type_val) == wrpl::packet_type::mpi) {
+            mpi = wrpl::read_mpi_message(payload);
+        }
+        timestamp_ms.push_back(packet.header ? packet.header->timestamp_ms : 0);
+        type.push_back(type_val);
+        object_id.push_back(mpi ? mpi->object_id : no_id);
+        message_id.push_back(mpi ? mpi->message_id : no_id);
+        payload_offset.push_back(static_cast<std::uint32_t>(payloads.size()));
+        payload_size.push_back(static_cast<std::uint32_t>(payload.size()));
+        auto bytes = reinterpret_cast<const std::uint8_t*>(payload.data());
+        payloads.insert(payloads.end(), bytes, bytes + payload.size());
+    }
+};
+
+template <typename T>
+emscripten::val column_view(const std::vector<T>& column) {
+    return emscripten::val(emscripten::typed_memory_view(column.size(), column.data()));
+}
+
+// Parses a replay while it downloads: chunks from a fetch() reader are pushed as they arrive and
+// every packet completed by a chunk is handed to `on_packet` right away. Only the replay header,
+// one chunk and the bytes of unfinished packets are held in wasm memory.
+//
+// Without a callback the packets are collected into columns instead. The column views alias wasm
+// memory and are only valid until the next push() or finish(), since a column may reallocate.
+class ReplayParser {
+public:
+    ReplayParser() = default;
+
+    explicit ReplayParser(emscripten::val on_packet) :
+        on_packet_{std::move(on_packet)}, collect_columns_{false} {
+    }
+
+    // Returns the number of packets completed by this chunk.
+    std::size_t push(const emscripten::val& chunk) {
+        std::size_t size = chunk["length"].as<std::size_t>();
+        if (!stream_found_) {
+            std::size_t old_size = head_.size();
+            head_.resize(old_size + size);
+            copy_from_js(chunk, std::span(head_).subspan(old_size));
+            return locate_stream(false);
+        }
+        chunk_.resize(size);
+        copy_from_js(chunk, chunk_);
+        framer_.push(std::as_bytes(std::span(chunk_)));
+        return drain();
+    }
+
+    // Flushes the packets left after the last chunk. Returns false if the stream was not found
+    // or framing stopped on an error; error() then tells why.
+    bool finish() {
+        if (!stream_found_) {
+            locate_stream(true);
+            if (!stream_found_) {
+                error_ = "zlib stream not found";
+                return false;
+            }
+        }
+        framer_.finish();
+        drain();
+        return error_.empty();
+    }
+
+    std::string error() const {
+        return error_;
+    }
+
+    // Parses a complete replay that is already in wasm memory. With pthreads, inflating runs on
+    // one worker thread and framing into the columns on another; call it from a Web Worker, since
+    // it blocks until both are done. Returns false if the stream was not found or inflating or
+    // framing failed, with error() telling why.
+    bool parse_all(std::span<const std::uint8_t> data) {
+        std::span<const std::byte> head = std::as_bytes(data);
+        std::vector<std::size_t> offsets =
+            wrpl::find_zlib_streams(head, wrpl::replay_header_size, 1);
+        if (offsets.empty()) {
+            error_ = "zlib stream not found";
+            return false;
+        }
+        stream_found_ = true;
+        std::span<const std::byte> compressed = head.subspan(offsets.front());
+#if defined(__EMSCRIPTEN_PTHREADS__)
+        inflate_pipelined(compressed);
+#else
+        framer_.push(compressed);
+#endif
+        framer_.finish();
+        drain();
+        return error_.empty();
+    }
+
+    std::size_t packetCount() const {
+        return columns_.type.size();
+    }
+
+    emscripten::val timestamps() const {
+        return column_view(columns_.timestamp_ms);
+    }
+
+    emscripten::val types() const {
+        return column_view(columns_.type);
+    }
+
+    emscripten::val objectIds() const {
+        return column_view(columns_.object_id);
+    }
+
+    emscripten::val messageIds() const {
+        return column_view(columns_.message_id);
+    }
+
+    emscripten::val payloadOffsets() const {
+        return column_view(columns_.payload_offset);
+    }
+
+    emscripten::val payloadSizes() const {
+        return column_view(columns_.payload_size);
+    }
+
+    emscripten::val payloads() const {
+        return column_view(columns_.payloads);
+    }
+
+private:
+    emscripten::val on_packet_ = emscripten::val::undefined();
+    // decided up front: JS values must not be touched from the framing thread
+    bool collect_columns_ = true;
+    packet_columns columns_;
+    wrpl::incremental_framer framer_;
+    std::vector<std::uint8_t> head_;
+    std::vector<std::uint8_t> chunk_;
+    bool stream_found_ = false;
+    // where the next stream search in head_ starts
+    std::size_t scan_from_ = wrpl::replay_header_size;
+    std::string error_;
+
+    // enough input after the header for the trial inflate that confirms the stream start
+    static constexpr std::size_t stream_probe_size = 4 * 1024;
+
+#if defined(__EMSCRIPTEN_PTHREADS__)
+    // Inflates `compressed` on one worker thread while another frames the inflated blocks into the
+    // columns. At most `max_queued_blocks` blocks are in flight.
+    void inflate_pipelined(std::span<const std::byte> compressed) {
+        constexpr std::size_t block_size = 256 * 1024;
+        constexpr std::size_t max_queued_blocks = 4;
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<std::vector<std::byte>> blocks;
+        bool inflated = false;
+        // written by the inflater under `mutex`; the framing thread owns error_ until both are done
+        std::string inflate_error;
+
+        std::jthread inflater([&] {
+            z_stream stream{};
+            std::string failure;
+            if (compressed.size() > std::numeric_limits<uInt>::max()) {
+                failure = "zlib stream too large";
+            } else if (inflateInit(&stream) != Z_OK) {
+                failure = wrpl::make_error_code(wrpl::parse_error::inflate_init_failed).message();
+            }
+            bool ok = failure.empty();
+            if (ok) {
+                stream.next_in =
+                    reinterpret_cast<Bytef*>(const_cast<std::byte*>(compressed.data()));
+                stream.avail_in = static_cast<uInt>(compressed.size());
+            }
+            int ret = Z_OK;
+            while (ok && ret == Z_OK) {
+                std::vector<std::byte> block(block_size);
+                stream.next_out = reinterpret_cast<Bytef*>(block.data());
+                stream.avail_out = static_cast<uInt>(block.size());
+                ret = inflate(&stream, Z_NO_FLUSH);
+                block.resize(block.size() - stream.avail_out);
+                if (block.empty()) {
+                    continue;
+                }
+                std::unique_lock lock(mutex);
+                changed.wait(lock, [&] {
+                    return blocks.size() < max_queued_blocks;
+                });
+                blocks.push_back(std::move(block));
+                changed.notify_all();
+            }
+            if (ok) {
+                // Z_BUF_ERROR: the input ran out before the end of the stream
+                if (ret == Z_BUF_ERROR) {
+                    failure = "zlib stream truncated";
+                } else if (ret != Z_STREAM_END) {
+                    failure = wrpl::make_error_code(wrpl::parse_error::inflate_failed).message();
+                    if (stream.msg != nullptr) {
+                        failure += std::string(": ") + stream.msg;
+                    }
+                }
+                inflateEnd(&stream);
+            }
+            std::lock_guard lock(mutex);
+            inflate_error = std::move(failure);
+            inflated = true;
+            changed.notify_all();
+        });
+
+        std::jthread framer([&] {
+            while (true) {
+                std::vector<std::byte> block;
+                {
+                    std::unique_lock lock(mutex);
+                    changed.wait(lock, [&] {
+                        return inflated || !blocks.empty();
+                    });
+                    if (blocks.empty()) {
+                        return;
+                    }
+                    block = std::move(blocks.front());
+                    blocks.pop_front();
+                    changed.notify_all();
+                }
+                framer_.push_inflated(block);
+                drain();
+            }
+        });
+
+        inflater.join();
+        framer.join();
+        std::lock_guard lock(mutex);
+        if (!inflate_error.empty() && error_.empty()) {
+            error_ = std::move(inflate_error);
+        }
+    }
+#endif
+
+    static void copy_from_js(const emscripten::val& chunk, std::span<std::uint8_t> out) {
+        emscripten::val view(emscripten::typed_memory_view(out.size(), out.data()));
+        view.call<void>("set", chunk);
+    }
+
+    // Scans only the bytes not rejected by an earlier push, so a late stream start stays linear.
+    // A candidate is only taken once a full probe of input follows it, or at the final chunk.
+    std::size_t locate_stream(bool final_chunk) {
+        if (!final_chunk && head_.size() < wrpl::replay_header_size + stream_probe_size) {
+            return 0;
+        }
+        std::span<const std::byte> head = std::as_bytes(std::span(head_));
+        std::vector<std::size_t> offsets = wrpl::find_zlib_streams(head, scan_from_, 1);
+        if (offsets.empty()) {
+            // every candidate up to the last byte failed its header or trial inflate checks,
+            // which more input cannot change; the last byte still lacks its FLG byte
+            scan_from_ = std::max(scan_from_, head_.size() - 1);
+            return 0;
+        }
+        if (!final_chunk && head_.size() - offsets.front() < stream_probe_size) {
+            scan_from_ = offsets.front();
+            return 0;
+        }
+        stream_found_ = true;
+        framer_.push(head.subspan(offsets.front()));
+        head_ = {};
+        return drain();
+    }
+
+    std::size_t drain() {
+        std::size_t count = 0;
+        while (true) {
+            auto packet = framer_.next_view();
+            if (!packet) {
+                error_ = packet.error().message();
+                break;
+            }
+            if (!*packet) {
+                break;
+            }
+            emit(**packet);
+            count++;
+        }
+        if (framer_.error() && error_.empty()) {
+            error_ = framer_.error().message();
+        }
+        return count;
+    }
+
+    void emit(const wrpl::packet_view& packet) {
+        if (collect_columns_) {
+            columns_.append(packet);
+            return;
+        }
+        emscripten::val object = emscripten::val::object();
+        object.set("index", packet.index);
+        object.set("size", static_cast<double>(packet.data.size()));
+        if (packet.header) {
+            object.set("type", packet.header->packet_type_val);
+            object.set("timestampMs", packet.header->timestamp_ms);
+            std::span<const std::byte> payload = packet.payload();
+            // the view aliases wasm memory that the next push may reuse, so JS gets a copy
+            emscripten::val view(emscripten::typed_memory_view(
+                payload.size(), reinterpret_cast<const std::uint8_t*>(payload.data())
+            ));
+            object.set("payload", view.call<emscripten::val>("slice"));
+        }
+        on_packet_(object);
+    }
+};
+
+// Copies `data` into wasm memory once and parses it into columns in one call.
+std::unique_ptr<ReplayParser> parse_replay_columns(const emscripten::val& data) {
+    std::vector<std::uint8_t> bytes(data["length"].as<std::size_t>());
+    emscripten::val(emscripten::typed_memory_view(bytes.size(), bytes.data()))
+        .call<void>("set", data);
+    auto parser = std::make_unique<ReplayParser>();
+    parser->parse_all(bytes);
+    return parser;
 }
 
 EMSCRIPTEN_BINDINGS(wrpl_module) {
     emscripten::function("parseReplay", &parse_replay);
+    emscripten::function("parseReplayColumns", &parse_replay_columns);
+    emscripten::class_<ReplayParser>("ReplayParser")
+        .constructor<>()
+        .constructor<emscripten::val>()
+        .function("push", &ReplayParser::push)
+        .function("finish", &ReplayParser::finish)
+        .function("error", &ReplayParser::error)
+        .function("packetCount", &ReplayParser::packetCount)
+        .function("timestamps", &ReplayParser::timestamps)
+        .function("types", &ReplayParser::types)
+        .function("objectIds", &ReplayParser::objectIds)
+        .function("messageIds", &ReplayParser::messageIds)
+        .function("payloadOffsets", &ReplayParser::payloadOffsets)
+        .function("payloadSizes", &ReplayParser::payloadSizes)
+        .function("payloads", &ReplayParser::payloads);
 }
@@ -0,0 +1,157 @@
+module;
+
+#include <print>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+export module chat;
+
+import deserializer;
+import json;
+import packet_stream;
+import parser;
+
+namespace wrpl {
+
+  export struct chat_entry {
+    std::uint32_t timestamp_ms;
+    std::uint32_t sender_id;
+    std::uint32_t text_offset;
+    std::uint32_t text_size;
+    std::uint8_t channel_id;
+    bool is_enemy;
+  };
+
+  struct string_hash {
+    using is_transparent = void;
+
+    std::size_t operator()(std::string_view text) const {
+      return std::hash<std::string_view>{}(text);
+    }
+  };
+
+  // Chat messages of one replay. Sender names are interned, since a match has only a few dozen
+  // senders, and message texts are appended to a single arena instead of owning a string each.
+  export class chat_transcript {
+public:
+    std::uint32_t intern_sender(std::string_view name) {
+      auto it = sender_ids_.find(name);
+      if (it != sender_ids_.end()) {
+        return it->second;
+      }
+      auto id = static_cast<std::uint32_t>(senders_.size());
+      auto inserted = sender_ids_.emplace(std::string(name), id).first;
+      senders_.push_back(inserted->first);
+      return id;
+    }
+
+    void add(
+      std::uint32_t timestamp_ms, std::string_view sender_name, std::string_view text,
+      std::uint8_t channel_id, bool is_enemy
+    ) {
+      chat_entry entry{
+        timestamp_ms,
+        intern_sender(sender_name),
+        static_cast<std::uint32_t>(arena_.size()),
+        static_cast<std::uint32_t>(text.size()),
+        channel_id,
+        is_enemy,
+      };
+      arena_.insert(arena_.end(), text.begin(), text.end());
+      entries_.push_back(entry);
+    }
+
+    std::string_view sender(std::uint32_t sender_id) const {
+      return senders_[sender_id];
+    }
+
+    std::string_view text(const chat_entry& entry) const {
+      return {arena_.data() + entry.text_offset, entry.text_size};
+    }
+
+    const std::vector<chat_entry>& entries() const {
+      return entries_;
+    }
+
+    std::size_t sender_count() const {
+      return senders_.size();
+    }
+
+private:
+    // node-based, so the views in senders_ stay valid as the table grows
+    std::unordered_map<std::string, std::uint32_t, string_hash, std::equal_to<>> sender_ids_;
+    std::vector<std::string_view> senders_;
+    std::vector<char> arena_;
+    std::vector<chat_entry> entries_;
+  };
+
+  export chat_transcript extract_chat(std::istream& compressed_stream) {
+    packet_filter chat_only;
+    chat_only.types.set(static_cast<std::uint8_t>(packet_type::chat));
+    chat_only.filter_types = true;
+
+    chat_transcript transcript;
+    std::string sender_name;
+    std::string message;
+
+    for (const packet_view& packet : packets(compressed_stream, chat_only)) {
+      if (!packet.header) {
+        continue;
+      }
+      auto fields = deserialize_chat_into(packet.payload(), sender_name, message);
+      if (!fields) {
+        continue;
+      }
+      transcript.add(
+        packet.header->timestamp_ms, sender_name, message, fields->channel_id, fields->is_enemy
+      );
+    }
+    return transcript;
+  }
+
+  export void print_chat_transcript(const chat_transcript& transcript, bool json) {
+    if (!json) {
+      for (const chat_entry& entry : transcript.entries()) {
+        std::println(
+          "{:>10} [{}] {} (ch {}{}): {}", entry.timestamp_ms, entry.sender_id,
+          transcript.sender(entry.sender_id), entry.channel_id, entry.is_enemy ? ", enemy" : "",
+          transcript.text(entry)
+        );
+      }
+      std::println(
+        "Total messages: {}, senders: {}", transcript.entries().size(), transcript.sender_count()
+      );
+      return;
+    }
+
+    std::print("{{\"senders\":[");
+    for (std::uint32_t id = 0; id < transcript.sender_count(); ++id) {
+      if (id > 0) {
+        std::print(",");
+      }
+      print_json_string(transcript.sender(id));
+    }
+    std::print("],\"messages\":[");
+    bool first = true;
+    for (const chat_entry& entry : transcript.entries()) {
+      std::print(
+        "{}{{\"time_ms\":{},\"sender\":{},\"channel\":{},\"is_enemy\":{},\"text\":",
+        first ? "" : ",", entry.timestamp_ms, entry.sender_id, entry.channel_id,
+        entry.is_enemy ? "true" : "false"
+      );
+      print_json_string(transcript.text(entry));
+      std::print("}}");
+      first = false;
+    }
+    std::println("]}}");
+  }
+
+} // namespace wrpl
@@ -2,10 +2,12 @@ module;
 
 #include <bitstream/bitstream.h>
 
+#include <bit>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <expected>
+#include <optional>
 #include <span>
 #include <string>
 #include <system_error>
@@ -13,6 +15,9 @@ module;
 
 export module deserializer;
 
+import memory_stats;
+import trace;
+
 namespace wrpl {
 
   enum class deserialize_error {
@@ -61,18 +66,43 @@ public:
     std::uint32_t bits_read{0};
   };
 
-  struct mpi_packet_data {
+  export struct chat_fields {
+    bool is_enemy{false};
+    std::uint8_t channel_id{0};
+    std::uint32_t bits_read{0};
+  };
+
+  // MPI (multiplayer interface) packets start with the addressed object id, one byte whose
+  // meaning is not known yet, and the message id. Everything after that is the message body.
+  export constexpr std::size_t mpi_header_size = 5;
+
+  // A decoded MPI header plus a view of the message body inside the packet payload.
+  export struct mpi_message {
     std::uint16_t object_id{0};
+    // meaning unknown; exposed so it can be inspected instead of silently skipped
+    std::uint8_t reserved{0};
     std::uint16_t message_id{0};
-    std::vector<std::byte> payload;
+    std::span<const std::byte> body;
   };
 
   struct generic_packet_data {
     std::vector<std::byte> raw_payload;
   };
 
-  std::expected<chat_packet_data, std::error_code>
-  deserialize_chat_packet(std::span<const std::byte> payload) {
+  std::uint16_t load_u16(std::span<const std::byte> payload, std::size_t offset) {
+    std::uint16_t value;
+    std::memcpy(&value, payload.data() + offset, sizeof(value));
+    if constexpr (std::endian::native == std::endian::big) {
+      value = std::byteswap(value);
+    }
+    return value;
+  }
+
+  // Decodes a chat packet into caller-owned strings, so callers that keep the strings around can
+  // reuse their capacity across packets.
+  std::expected<chat_fields, std::error_code> deserialize_chat_packet_into(
+    std::span<const std::byte> payload, std::string& sender_name, std::string& message
+  ) {
     if (payload.empty()) {
       return std::unexpected(make_error_code(deserialize_error::insufficient_data));
     }
@@ -81,8 +111,10 @@ public:
       reinterpret_cast<const std::uint8_t*>(payload.data()), payload.size(), false
     );
 
-    chat_packet_data result;
+    chat_fields result;
     bool read_ok = true;
+    sender_name.clear();
+    message.clear();
 
     // ignored
     std::uint16_t prefix_len = 0;
@@ -97,11 +129,8 @@ public:
     }
 
     if (read_ok && sender_len > 0) {
-      std::vector<char> sender_buf(sender_len + 1, '\0');
-      read_ok &= bs.Read(sender_buf.data(), sender_len);
-      if (read_ok) {
-        result.sender_name.assign(sender_buf.data(), sender_len);
-      }
+      sender_name.resize(sender_len);
+      read_ok &= bs.Read(sender_name.data(), sender_len);
     }
 
     std::uint16_t message_len = 0;
@@ -110,11 +139,8 @@ public:
     }
 
     if (read_ok && message_len > 0) {
-      std::vector<char> message_buf(message_len + 1, '\0');
-      read_ok &= bs.Read(message_buf.data(), message_len);
-      if (read_ok) {
-        result.message.assign(message_buf.data(), message_len);
-      }
+      message.resize(message_len);
+      read_ok &= bs.Read(message.data(), message_len);
     }
 
     if (read_ok && bs.GetNumberOfUnreadBits() >= 8) {
@@ -133,22 +159,31 @@ public:
     return result;
   }
 
-  std::expected<mpi_packet_data, std::error_code>
-  deserialize_mpi_packet(std::span<const std::byte> payload) {
-    if (payload.size() < 4) {
-      return std::unexpected(make_error_code(deserialize_error::insufficient_data));
+  std::expected<chat_packet_data, std::error_code>
+  deserialize_chat_packet(std::span<const std::byte> payload) {
+    chat_packet_data result;
+    auto fields = deserialize_chat_packet_into(payload, result.sender_name, result.message);
+    if (!fields) {
+      return std::unexpected(fields.error());
     }
+    result.is_enemy = fields->is_enemy;
+    result.channel_id = fields->channel_id;
+    result.bits_read = fields->bits_read;
+    return result;
+  }
 
-    mpi_packet_data result;
-    std::memcpy(&result.object_id, payload.data(), sizeof(result.object_id));
-    std::memcpy(&result.message_id, payload.data() + 2, sizeof(result.message_id));
-
-    if (payload.size() > 4) {
-      result.payload.resize(payload.size() - 4);
-      std::memcpy(result.payload.data(), payload.data() + 4, payload.size() - 4);
+  // The one place the MPI header is decoded; `payload` is the packet payload after the packet
+  // header, and the returned body points into it.
+  export std::optional<mpi_message> read_mpi_message(std::span<const std::byte> payload) {
+    if (payload.size() < mpi_header_size) {
+      return std::nullopt;
     }
-
-    return result;
+    mpi_message message;
+    message.object_id = load_u16(payload, 0);
+    message.reserved = static_cast<std::uint8_t>(payload[2]);
+    message.message_id = load_u16(payload, 3);
+    message.body = payload.subspan(mpi_header_size);
+    return message;
   }
 
   std::expected<generic_packet_data, std::error_code>
@@ -160,16 +195,23 @@ public:
 
   export std::expected<chat_packet_data, std::error_code>
   deserialize_chat(std::span<const std::byte> payload) {
+    memory_stage_scope stage(memory_stage::deserialize);
+    trace_span span("deserialize chat");
     return deserialize_chat_packet(payload);
   }
 
-  export std::expected<mpi_packet_data, std::error_code>
-  deserialize_mpi(std::span<const std::byte> payload) {
-    return deserialize_mpi_packet(payload);
+  export std::expected<chat_fields, std::error_code> deserialize_chat_into(
+    std::span<const std::byte> payload, std::string& sender_name, std::string& message
+  ) {
+    memory_stage_scope stage(memory_stage::deserialize);
+    trace_span span("deserialize chat");
+    return deserialize_chat_packet_into(payload, sender_name, message);
   }
 
   export std::expected<generic_packet_data, std::error_code>
   deserialize_generic(std::span<const std::byte> payload) {
+    memory_stage_scope stage(memory_stage::deserialize);
+    trace_span span("deserialize generic");
     return deserialize_generic_packet(payload);
   }
 
@@ -0,0 +1,195 @@
+module;
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <span>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+export module follow;
+
+import header;
+import parser;
+import stream_scan;
+import trace;
+
+namespace wrpl {
+
+  // Blocks until `path` was written to or `timeout` passed. Uses inotify where available; elsewhere
+  // (or if the watch cannot be set up) it just sleeps, so growth is noticed on the next poll.
+  class file_change_waiter {
+public:
+    explicit file_change_waiter(const std::filesystem::path& path) {
+#if defined(__linux__)
+      fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+      if (fd_ >= 0 && inotify_add_watch(fd_, path.c_str(), IN_MODIFY | IN_CLOSE_WRITE) < 0) {
+        close(fd_);
+        fd_ = -1;
+      }
+#endif
+    }
+
+    ~file_change_waiter() {
+#if defined(__linux__)
+      if (fd_ >= 0) {
+        close(fd_);
+      }
+#endif
+    }
+
+    file_change_waiter(const file_change_waiter&) = delete;
+    file_change_waiter& operator=(const file_change_waiter&) = delete;
+
+    // Returns true once a writer closed the file, which only inotify can tell.
+    bool wait(std::chrono::milliseconds timeout) {
+#if defined(__linux__)
+      if (fd_ >= 0) {
+        bool closed = false;
+        pollfd watch{fd_, POLLIN, 0};
+        if (poll(&watch, 1, static_cast<int>(timeout.count())) > 0) {
+          // apart from a close, the events only wake us up; the file is read again regardless
+          alignas(inotify_event) char events[4096];
+          ssize_t length;
+          while ((length = read(fd_, events, sizeof(events))) > 0) {
+            for (ssize_t pos = 0; pos < length;) {
+              auto* event = reinterpret_cast<const inotify_event*>(events + pos);
+              closed = closed || (event->mask & IN_CLOSE_WRITE) != 0;
+              pos += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+            }
+          }
+        }
+        return closed;
+      }
+#endif
+      std::this_thread::sleep_for(timeout);
+      return false;
+    }
+
+private:
+#if defined(__linux__)
+    int fd_ = -1;
+#endif
+  };
+
+  export struct follow_options {
+    packet_filter filter;
+    // upper bound on how long appended bytes go unnoticed when no change notification arrives
+    std::chrono::milliseconds poll_interval{100};
+    // a file that has not grown for this long is treated as finished, for writers whose close
+    // cannot be observed
+    std::chrono::milliseconds idle_timeout{30000};
+  };
+
+  // Parses a replay that is still being written. The inflate state stays alive between reads, so
+  // appended bytes are framed as they arrive and nothing is parsed twice. Returns once the deflate
+  // stream has ended, or with an error code if it turned out to be corrupt, was never found, or
+  // the writer finished the file before the stream ended.
+  export std::error_code follow_replay(
+    const std::filesystem::path& path, const follow_options& options,
+    const std::function<void(const packet_view&)>& on_packet
+  ) {
+    constexpr std::size_t read_size = 64 * 1024;
+    // enough input after the header for the trial inflate that confirms the stream start
+    constexpr std::size_t stream_probe_size = 4 * 1024;
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+      return std::make_error_code(std::errc::no_such_file_or_directory);
+    }
+    file_change_waiter waiter(path);
+    incremental_framer framer;
+    std::vector<std::byte> head;
+    // where the next stream search in `head` starts; bytes before it were already rejected
+    std::size_t scan_from = replay_header_size;
+    std::vector<std::byte> chunk(read_size);
+    bool stream_found = false;
+    bool writer_closed = false;
+    std::chrono::milliseconds idle{0};
+
+    // frames the batch of packets completed by one read
+    auto emit_framed = [&]() -> std::error_code {
+      trace_span span("frame batch");
+      while (true) {
+        auto packet = framer.next_view();
+        if (!packet) {
+          return packet.error();
+        }
+        if (!*packet) {
+          return {};
+        }
+        if (options.filter.empty() || options.filter.accepts(**packet)) {
+          on_packet(**packet);
+        }
+      }
+    };
+
+    while (true) {
+      file.clear();
+      file.read(reinterpret_cast<char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+      auto bytes_read = static_cast<std::size_t>(file.gcount());
+      // nothing new after the writer closed the file, or after a long silence: what is buffered
+      // is all there will be
+      bool finished = bytes_read == 0 && (writer_closed || idle >= options.idle_timeout);
+      if (bytes_read == 0 && !finished) {
+        writer_closed = waiter.wait(options.poll_interval) || writer_closed;
+        idle += options.poll_interval;
+        continue;
+      }
+      idle = std::chrono::milliseconds{0};
+      std::span<const std::byte> input = std::span(chunk).first(bytes_read);
+
+      if (!stream_found) {
+        head.insert(head.end(), input.begin(), input.end());
+        if (!finished && head.size() < replay_header_size + stream_probe_size) {
+          continue;
+        }
+        std::vector<std::size_t> offsets = find_zlib_streams(head, scan_from, 1);
+        if (offsets.empty()) {
+          if (finished) {
+            return make_error_code(parse_error::stream_not_found);
+          }
+          // rejections are final, so later reads only scan what they append; the last byte still
+          // lacks the second byte of its zlib header
+          scan_from = std::max(scan_from, head.size() - 1);
+          continue;
+        }
+        if (!finished && head.size() - offsets.front() < stream_probe_size) {
+          scan_from = offsets.front();
+          continue;
+        }
+        stream_found = true;
+        input = std::span<const std::byte>(head).subspan(offsets.front());
+      }
+
+      if (std::error_code error = framer.push(input)) {
+        return error;
+      }
+      head = {};
+      if (finished) {
+        framer.finish();
+      }
+      if (std::error_code error = emit_framed()) {
+        return error;
+      }
+      if (framer.done()) {
+        return {};
+      }
+      if (finished) {
+        return make_error_code(parse_error::truncated_stream);
+      }
+    }
+  }
+
+} // namespace wrpl
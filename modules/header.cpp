@@ -0,0 +1,155 @@
+module;
+
+#include <print>
+
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+export module header;
+
+import json;
+
+namespace wrpl {
+
+  export constexpr std::uint32_t replay_magic = 0x1000ACE5;
+  // fixed part of the header; the settings blk (`settings_size` bytes) follows it
+  export constexpr std::size_t replay_header_size = 0x4C6;
+
+  export struct replay_header {
+    std::uint32_t version = 0;
+    std::string level;
+    std::string level_settings;
+    std::string battle_type;
+    std::string environment;
+    std::string visibility;
+    std::uint32_t results_offset = 0;
+    std::uint8_t difficulty = 0;
+    std::uint32_t session_type = 0;
+    std::uint64_t session_id = 0;
+    std::uint32_t settings_size = 0;
+    std::string location_name;
+    std::uint32_t start_time = 0;
+    std::uint32_t time_limit = 0;
+    std::uint32_t score_limit = 0;
+    std::string battle_class;
+    std::string battle_kill_streak;
+  };
+
+  class header_reader {
+public:
+    explicit header_reader(std::span<const std::byte> data) : data_{data} {
+    }
+
+    template <typename T>
+    T read() {
+      T value;
+      std::memcpy(&value, data_.data() + position_, sizeof(value));
+      position_ += sizeof(value);
+      if constexpr (std::endian::native == std::endian::big && sizeof(T) > 1) {
+        value = std::byteswap(value);
+      }
+      return value;
+    }
+
+    // fixed size, NUL padded char array
+    std::string read_string(std::size_t size) {
+      std::string_view text(reinterpret_cast<const char*>(data_.data() + position_), size);
+      position_ += size;
+      return std::string(text.substr(0, text.find('\0')));
+    }
+
+    void skip(std::size_t size) {
+      position_ += size;
+    }
+
+private:
+    std::span<const std::byte> data_;
+    std::size_t position_ = 0;
+  };
+
+  // Parses the fixed replay header. The player list and battle results are not part of it; they
+  // live in the results blk at `results_offset`.
+  export std::optional<replay_header> parse_replay_header(std::span<const std::byte> data) {
+    if (data.size() < replay_header_size) {
+      return std::nullopt;
+    }
+
+    header_reader reader(data);
+    if (reader.read<std::uint32_t>() != replay_magic) {
+      return std::nullopt;
+    }
+
+    replay_header header;
+    header.version = reader.read<std::uint32_t>();
+    header.level = reader.read_string(128);
+    header.level_settings = reader.read_string(260);
+    header.battle_type = reader.read_string(128);
+    header.environment = reader.read_string(128);
+    header.visibility = reader.read_string(32);
+    header.results_offset = reader.read<std::uint32_t>();
+    header.difficulty = reader.read<std::uint8_t>() & 0x0F;
+    reader.skip(35);
+    header.session_type = reader.read<std::uint32_t>();
+    reader.skip(4);
+    header.session_id = reader.read<std::uint64_t>();
+    reader.skip(4);
+    header.settings_size = reader.read<std::uint32_t>();
+    reader.skip(28);
+    header.location_name = reader.read_string(128);
+    header.start_time = reader.read<std::uint32_t>();
+    header.time_limit = reader.read<std::uint32_t>();
+    header.score_limit = reader.read<std::uint32_t>();
+    reader.skip(48);
+    header.battle_class = reader.read_string(128);
+    header.battle_kill_streak = reader.read_string(128);
+    return header;
+  }
+
+  std::string format_start_time(std::uint32_t start_time) {
+    std::chrono::sys_seconds time{std::chrono::seconds{start_time}};
+    return std::format("{:%Y-%m-%d %H:%M:%S}", time);
+  }
+
+  export void print_replay_header(std::string_view path, const replay_header& header, bool json) {
+    if (!json) {
+      std::println(
+        "{}: version={} level='{}' location='{}' battle_type='{}' difficulty={} session={:#x} "
+        "start='{}' time_limit={} environment='{}'",
+        path, header.version, header.level, header.location_name, header.battle_type,
+        header.difficulty, header.session_id, format_start_time(header.start_time),
+        header.time_limit, header.environment
+      );
+      return;
+    }
+
+    std::print("{{\"path\":");
+    print_json_string(path);
+    std::print(",\"version\":{},\"level\":", header.version);
+    print_json_string(header.level);
+    std::print(",\"location\":");
+    print_json_string(header.location_name);
+    std::print(",\"battle_type\":");
+    print_json_string(header.battle_type);
+    std::print(",\"battle_class\":");
+    print_json_string(header.battle_class);
+    std::print(",\"environment\":");
+    print_json_string(header.environment);
+    std::print(",\"visibility\":");
+    print_json_string(header.visibility);
+    std::println(
+      ",\"difficulty\":{},\"session_type\":{},\"session_id\":{},\"start_time\":{},"
+      "\"time_limit\":{},\"score_limit\":{},\"results_offset\":{}}}",
+      header.difficulty, header.session_type, header.session_id, header.start_time,
+      header.time_limit, header.score_limit, header.results_offset
+    );
+  }
+
+} // namespace wrpl
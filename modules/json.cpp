@@ -0,0 +1,112 @@
+module;
+
+#include <print>
+
+#include <cstddef>
+#include <cstdio>
+#include <string_view>
+
+export module json;
+
+namespace wrpl {
+
+  // Length of the well-formed UTF-8 sequence at the start of `text`, or 0 if it is not one.
+  // Overlong forms, surrogates and code points above U+10FFFF count as malformed.
+  std::size_t utf8_sequence_length(std::string_view text) {
+    auto byte = [&](std::size_t i) {
+      return static_cast<unsigned char>(text[i]);
+    };
+    unsigned char lead = byte(0);
+    std::size_t length = 0;
+    unsigned char min_second = 0x80;
+    unsigned char max_second = 0xBF;
+    if (lead < 0x80) {
+      return 1;
+    }
+    if (lead >= 0xC2 && lead <= 0xDF) {
+      length = 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+      length = 3;
+      min_second = lead == 0xE0 ? 0xA0 : 0x80;
+      max_second = lead == 0xED ? 0x9F : 0xBF;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+      length = 4;
+      min_second = lead == 0xF0 ? 0x90 : 0x80;
+      max_second = lead == 0xF4 ? 0x8F : 0xBF;
+    } else {
+      return 0;
+    }
+    if (text.size() < length || byte(1) < min_second || byte(1) > max_second) {
+      return 0;
+    }
+    for (std::size_t i = 2; i < length; ++i) {
+      if ((byte(i) & 0xC0) != 0x80) {
+        return 0;
+      }
+    }
+    return length;
+  }
+
+  // Writes `text` as a JSON string. Replay strings are not guaranteed to be UTF-8, so every
+  // malformed byte is written as U+FFFD to keep the output valid JSON.
+  export void print_json_string(std::FILE* out, std::string_view text) {
+    std::print(out, "\"");
+    std::size_t run_start = 0;
+    std::size_t pos = 0;
+    auto flush_run = [&] {
+      if (pos > run_start) {
+        std::print(out, "{}", text.substr(run_start, pos - run_start));
+      }
+    };
+    while (pos < text.size()) {
+      char c = text[pos];
+      const char* escape = nullptr;
+      switch (c) {
+        case '"':
+          escape = "\\\"";
+          break;
+        case '\\':
+          escape = "\\\\";
+          break;
+        case '\n':
+          escape = "\\n";
+          break;
+        case '\r':
+          escape = "\\r";
+          break;
+        case '\t':
+          escape = "\\t";
+          break;
+        default:
+          break;
+      }
+      if (escape) {
+        flush_run();
+        std::print(out, "{}", escape);
+        run_start = ++pos;
+        continue;
+      }
+      if (static_cast<unsigned char>(c) < 0x20) {
+        flush_run();
+        std::print(out, "\\u{:04x}", static_cast<unsigned>(c));
+        run_start = ++pos;
+        continue;
+      }
+      std::size_t length = utf8_sequence_length(text.substr(pos));
+      if (length == 0) {
+        flush_run();
+        std::print(out, "\\ufffd");
+        run_start = ++pos;
+        continue;
+      }
+      pos += length;
+    }
+    flush_run();
+    std::print(out, "\"");
+  }
+
+  export void print_json_string(std::string_view text) {
+    print_json_string(stdout, text);
+  }
+
+} // namespace wrpl
@@ -0,0 +1,189 @@
+module;
+
+#include <print>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#include <sys/resource.h>
+#endif
+
+export module memory_stats;
+
+namespace wrpl {
+
+  // Pipeline stages that heap allocations are charged to. `other` is everything outside a
+  // memory_stage_scope.
+  export enum class memory_stage : std::uint8_t {
+    other,
+    inflate,
+    framing,
+    deserialize,
+    output,
+  };
+
+  constexpr std::size_t memory_stage_count = 5;
+
+  export constexpr const char* get_memory_stage_name(memory_stage stage) {
+    switch (stage) {
+      case memory_stage::other:
+        return "other";
+      case memory_stage::inflate:
+        return "inflate";
+      case memory_stage::framing:
+        return "framing";
+      case memory_stage::deserialize:
+        return "deserialize";
+      case memory_stage::output:
+        return "output";
+    }
+    return "unknown";
+  }
+
+#if defined(WRPL_MEMORY_STATS)
+  export constexpr bool memory_stats_enabled = true;
+#else
+  export constexpr bool memory_stats_enabled = false;
+#endif
+
+  export struct stage_memory {
+    std::uint64_t allocations = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t live_bytes = 0;
+    std::uint64_t peak_live_bytes = 0;
+  };
+
+  struct stage_counters {
+    std::atomic<std::uint64_t> allocations{0};
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> live_bytes{0};
+    std::atomic<std::uint64_t> peak_live_bytes{0};
+  };
+
+  // constant initialized, so allocations made before main are counted safely
+  std::array<stage_counters, memory_stage_count> stage_totals;
+  stage_counters all_stages;
+  thread_local memory_stage current_stage = memory_stage::other;
+
+  void raise_peak(std::atomic<std::uint64_t>& peak, std::uint64_t value) {
+    std::uint64_t seen = peak.load(std::memory_order_relaxed);
+    while (seen < value && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    }
+  }
+
+  void add(stage_counters& counters, std::size_t size) {
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes.fetch_add(size, std::memory_order_relaxed);
+    std::uint64_t live = counters.live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    raise_peak(counters.peak_live_bytes, live);
+  }
+
+  // Charges the allocations of the current thread to `stage` until the scope ends. Compiles to
+  // nothing unless WRPL_MEMORY_STATS is defined.
+  export class memory_stage_scope {
+public:
+    explicit memory_stage_scope([[maybe_unused]] memory_stage stage) {
+#if defined(WRPL_MEMORY_STATS)
+      previous_ = current_stage;
+      current_stage = stage;
+#endif
+    }
+
+    ~memory_stage_scope() {
+#if defined(WRPL_MEMORY_STATS)
+      current_stage = previous_;
+#endif
+    }
+
+    memory_stage_scope(const memory_stage_scope&) = delete;
+    memory_stage_scope& operator=(const memory_stage_scope&) = delete;
+
+private:
+#if defined(WRPL_MEMORY_STATS)
+    memory_stage previous_;
+#endif
+  };
+
+  export memory_stage current_memory_stage() {
+    return current_stage;
+  }
+
+  // Called by the global allocation hooks of WRPL_MEMORY_STATS builds; must not allocate.
+  export void record_allocation(memory_stage stage, std::size_t size) {
+    add(stage_totals[static_cast<std::size_t>(stage)], size);
+    add(all_stages, size);
+  }
+
+  export void record_free(memory_stage stage, std::size_t size) {
+    stage_totals[static_cast<std::size_t>(stage)].live_bytes.fetch_sub(
+      size, std::memory_order_relaxed
+    );
+    all_stages.live_bytes.fetch_sub(size, std::memory_order_relaxed);
+  }
+
+  stage_memory snapshot(const stage_counters& counters) {
+    return {
+      counters.allocations.load(std::memory_order_relaxed),
+      counters.bytes.load(std::memory_order_relaxed),
+      counters.live_bytes.load(std::memory_order_relaxed),
+      counters.peak_live_bytes.load(std::memory_order_relaxed),
+    };
+  }
+
+  export stage_memory stage_memory_usage(memory_stage stage) {
+    return snapshot(stage_totals[static_cast<std::size_t>(stage)]);
+  }
+
+  export stage_memory total_memory_usage() {
+    return snapshot(all_stages);
+  }
+
+  export std::optional<std::uint64_t> peak_rss_bytes() {
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+      return std::nullopt;
+    }
+#if defined(__APPLE__)
+    return static_cast<std::uint64_t>(usage.ru_maxrss);
+#else
+    // kilobytes everywhere but macOS
+    return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+    return std::nullopt;
+#endif
+  }
+
+  // Per-stage allocation counts, bytes and peak live bytes, then the overall peaks. The total
+  // peak is not the sum of the stage peaks, since stages rarely peak at the same time.
+  export void print_memory_report(std::FILE* out) {
+    if (!memory_stats_enabled) {
+      std::println(out, "Memory stats: not compiled in (configure with -DWRPL_MEMORY_STATS=ON)");
+      return;
+    }
+    std::println(out, "{:<12} {:>12} {:>16} {:>16}", "stage", "allocations", "bytes", "peak live");
+    for (std::size_t i = 0; i < memory_stage_count; ++i) {
+      auto stage = static_cast<memory_stage>(i);
+      stage_memory usage = stage_memory_usage(stage);
+      std::println(
+        out, "{:<12} {:>12} {:>16} {:>16}", get_memory_stage_name(stage), usage.allocations,
+        usage.bytes, usage.peak_live_bytes
+      );
+    }
+    stage_memory total = total_memory_usage();
+    std::println(
+      out, "{:<12} {:>12} {:>16} {:>16}", "total", total.allocations, total.bytes,
+      total.peak_live_bytes
+    );
+    if (std::optional<std::uint64_t> rss = peak_rss_bytes()) {
+      std::println(out, "peak RSS: {} bytes", *rss);
+    }
+  }
+
+} // namespace wrpl
@@ -0,0 +1,170 @@
+module;
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+export module merge;
+
+import parser;
+import trace;
+
+namespace wrpl {
+
+  // Single producer, single consumer queue that blocks the producer once `capacity` items are
+  // waiting, which is what bounds memory per source.
+  template <typename T>
+  class bounded_queue {
+public:
+    explicit bounded_queue(std::size_t capacity) : capacity_{capacity} {
+    }
+
+    bool push(T item) {
+      std::unique_lock lock(mutex_);
+      not_full_.wait(lock, [&] {
+        return closed_ || items_.size() < capacity_;
+      });
+      if (closed_) {
+        return false;
+      }
+      items_.push_back(std::move(item));
+      not_empty_.notify_one();
+      return true;
+    }
+
+    std::optional<T> pop() {
+      std::unique_lock lock(mutex_);
+      not_empty_.wait(lock, [&] {
+        return closed_ || !items_.empty();
+      });
+      if (items_.empty()) {
+        return std::nullopt;
+      }
+      T item = std::move(items_.front());
+      items_.pop_front();
+      not_full_.notify_one();
+      return item;
+    }
+
+    void close() {
+      std::lock_guard lock(mutex_);
+      closed_ = true;
+      not_full_.notify_all();
+      not_empty_.notify_all();
+    }
+
+private:
+    std::size_t capacity_;
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::deque<T> items_;
+    bool closed_ = false;
+  };
+
+  export struct tagged_packet {
+    std::size_t source;
+    framed_packet packet;
+  };
+
+  // Merges the packets of several replays of the same match by timestamp. Every source is framed
+  // on its own thread into a bounded queue, and a heap over the queue heads yields the packet with
+  // the lowest timestamp next; ties keep source order. A source that fails to frame ends early
+  // and the others keep merging; its error is kept for error().
+  export class replay_merger {
+public:
+    explicit replay_merger(
+      const std::vector<std::istream*>& sources, std::size_t buffered_packets_per_source = 256
+    ) {
+      for (std::size_t i = 0; i < sources.size(); ++i) {
+        queues_.push_back(
+          std::make_unique<bounded_queue<framed_packet>>(buffered_packets_per_source)
+        );
+      }
+      errors_.resize(sources.size());
+      for (std::size_t i = 0; i < sources.size(); ++i) {
+        workers_.emplace_back([queue = queues_[i].get(), stream = sources[i], &error = errors_[i]] {
+          packet_framer framer(*stream);
+          auto packet = framer.next();
+          for (; packet && *packet; packet = framer.next()) {
+            // time spent blocked on a full queue shows up as long spans
+            trace_span span("queue packet");
+            if (!queue->push(std::move(**packet))) {
+              break;
+            }
+          }
+          if (!packet) {
+            error = packet.error();
+          }
+          // closing publishes the error to the thread that pops the end of this queue
+          queue->close();
+        });
+      }
+
+      heads_.resize(sources.size());
+      last_timestamps_.resize(sources.size(), 0);
+      for (std::size_t i = 0; i < sources.size(); ++i) {
+        refill(i);
+      }
+    }
+
+    ~replay_merger() {
+      for (auto& queue : queues_) {
+        queue->close();
+      }
+    }
+
+    replay_merger(const replay_merger&) = delete;
+    replay_merger& operator=(const replay_merger&) = delete;
+
+    std::optional<tagged_packet> next() {
+      if (heap_.empty()) {
+        return std::nullopt;
+      }
+      std::size_t source = heap_.top().second;
+      heap_.pop();
+      tagged_packet result{source, std::move(*heads_[source])};
+      refill(source);
+      return result;
+    }
+
+    // Why framing `source` stopped early, or an empty code. Set once next() has returned nullopt.
+    std::error_code error(std::size_t source) const {
+      return errors_[source];
+    }
+
+private:
+    using heap_entry = std::pair<std::uint32_t, std::size_t>;
+
+    std::vector<std::unique_ptr<bounded_queue<framed_packet>>> queues_;
+    std::vector<std::optional<framed_packet>> heads_;
+    std::vector<std::uint32_t> last_timestamps_;
+    std::priority_queue<heap_entry, std::vector<heap_entry>, std::greater<>> heap_;
+    std::vector<std::error_code> errors_;
+    // declared last so the workers are joined before the queues they push to are destroyed
+    std::vector<std::jthread> workers_;
+
+    void refill(std::size_t source) {
+      heads_[source] = queues_[source]->pop();
+      if (!heads_[source]) {
+        return;
+      }
+      if (heads_[source]->header) {
+        last_timestamps_[source] = heads_[source]->header->timestamp_ms;
+      }
+      heap_.push({last_timestamps_[source], source});
+    }
+  };
+
+} // namespace wrpl
@@ -0,0 +1,277 @@
+module;
+
+#include <print>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <optional>
+#include <span>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+export module object_index;
+
+import deserializer;
+import packet_stream;
+import parser;
+
+namespace wrpl {
+
+  export struct packet_location {
+    std::uint32_t packet_index;
+    std::uint64_t decompressed_offset;
+    std::uint32_t timestamp_ms;
+  };
+
+  export void write_varint(std::vector<std::byte>& out, std::uint64_t value) {
+    while (value >= 0x80) {
+      out.push_back(static_cast<std::byte>((value & 0x7F) | 0x80));
+      value >>= 7;
+    }
+    out.push_back(static_cast<std::byte>(value));
+  }
+
+  export std::optional<std::uint64_t> read_varint(
+    std::span<const std::byte> data, std::size_t& pos
+  ) {
+    std::uint64_t value = 0;
+    for (int shift = 0; shift < 64 && pos < data.size(); shift += 7) {
+      std::uint8_t byte = static_cast<std::uint8_t>(data[pos++]);
+      value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) {
+        return value;
+      }
+    }
+    return std::nullopt;
+  }
+
+  export std::uint64_t zigzag_encode(std::int64_t value) {
+    return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+  }
+
+  export std::int64_t zigzag_decode(std::uint64_t value) {
+    return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+  }
+
+  // Size and modification time of a replay file. An index records the stamp of the replay it was
+  // built from, so one left behind by an overwritten or re-recorded replay is detected as stale.
+  export struct replay_stamp {
+    std::uint64_t size = 0;
+    std::int64_t modified = 0;
+
+    bool operator==(const replay_stamp&) const = default;
+  };
+
+  export std::optional<replay_stamp> stamp_replay(const std::filesystem::path& path) {
+    std::error_code ec;
+    std::uint64_t size = std::filesystem::file_size(path, ec);
+    if (ec) {
+      return std::nullopt;
+    }
+    std::filesystem::file_time_type modified = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+      return std::nullopt;
+    }
+    return replay_stamp{size, static_cast<std::int64_t>(modified.time_since_epoch().count())};
+  }
+
+  // Inverted index from MPI object id to the packets that address it. Each posting list is stored
+  // as varint deltas of (packet index, decompressed offset, timestamp), so a long replay costs a few
+  // bytes per entry.
+  export class object_index {
+public:
+    static constexpr std::uint32_t MAGIC = 0x32494F57; // "WOI2"
+
+    void add(std::uint16_t object_id, const packet_location& location) {
+      posting_list& list = lists_[object_id];
+      write_varint(list.encoded, location.packet_index - list.last.packet_index);
+      write_varint(list.encoded, location.decompressed_offset - list.last.decompressed_offset);
+      write_varint(
+        list.encoded, zigzag_encode(
+                        static_cast<std::int64_t>(location.timestamp_ms) -
+                        static_cast<std::int64_t>(list.last.timestamp_ms)
+                      )
+      );
+      list.last = location;
+      list.count++;
+    }
+
+    std::vector<packet_location> find(std::uint16_t object_id) const {
+      std::vector<packet_location> result;
+      auto it = lists_.find(object_id);
+      if (it == lists_.end()) {
+        return result;
+      }
+      result.reserve(it->second.count);
+      decode(it->second.encoded, it->second.count, result);
+      return result;
+    }
+
+    std::size_t object_count() const {
+      return lists_.size();
+    }
+
+    // Heap bytes held by the posting lists, without building the serialized form.
+    std::size_t memory_bytes() const {
+      std::size_t bytes = 0;
+      for (const auto& [object_id, list] : lists_) {
+        bytes += sizeof(object_id) + sizeof(list) + list.encoded.capacity();
+      }
+      return bytes;
+    }
+
+    const replay_stamp& source() const {
+      return source_;
+    }
+
+    void set_source(const replay_stamp& source) {
+      source_ = source;
+    }
+
+    std::vector<std::byte> serialize() const {
+      std::vector<std::byte> out;
+      write_varint(out, MAGIC);
+      write_varint(out, source_.size);
+      write_varint(out, zigzag_encode(source_.modified));
+      write_varint(out, lists_.size());
+
+      std::vector<std::uint16_t> object_ids;
+      object_ids.reserve(lists_.size());
+      for (const auto& [object_id, list] : lists_) {
+        object_ids.push_back(object_id);
+      }
+      std::ranges::sort(object_ids);
+
+      for (std::uint16_t object_id : object_ids) {
+        const posting_list& list = lists_.at(object_id);
+        write_varint(out, object_id);
+        write_varint(out, list.count);
+        write_varint(out, list.encoded.size());
+        out.insert(out.end(), list.encoded.begin(), list.encoded.end());
+      }
+      return out;
+    }
+
+    static std::optional<object_index> deserialize(std::span<const std::byte> data) {
+      std::size_t pos = 0;
+      std::optional<std::uint64_t> magic = read_varint(data, pos);
+      std::optional<std::uint64_t> source_size = read_varint(data, pos);
+      std::optional<std::uint64_t> source_modified = read_varint(data, pos);
+      std::optional<std::uint64_t> list_count = read_varint(data, pos);
+      if (!magic || *magic != MAGIC || !source_size || !source_modified || !list_count) {
+        return std::nullopt;
+      }
+
+      object_index index;
+      index.source_ = {*source_size, zigzag_decode(*source_modified)};
+      for (std::uint64_t i = 0; i < *list_count; ++i) {
+        std::optional<std::uint64_t> object_id = read_varint(data, pos);
+        std::optional<std::uint64_t> count = read_varint(data, pos);
+        std::optional<std::uint64_t> encoded_size = read_varint(data, pos);
+        if (!object_id || !count || !encoded_size || *encoded_size > data.size() - pos) {
+          return std::nullopt;
+        }
+
+        posting_list& list = index.lists_[static_cast<std::uint16_t>(*object_id)];
+        std::span<const std::byte> encoded = data.subspan(pos, *encoded_size);
+        list.encoded.assign(encoded.begin(), encoded.end());
+        list.count = static_cast<std::uint32_t>(*count);
+        pos += *encoded_size;
+
+        std::vector<packet_location> locations;
+        if (!decode(list.encoded, list.count, locations)) {
+          return std::nullopt;
+        }
+        if (!locations.empty()) {
+          list.last = locations.back();
+        }
+      }
+      return index;
+    }
+
+private:
+    struct posting_list {
+      std::vector<std::byte> encoded;
+      std::uint32_t count = 0;
+      packet_location last{};
+    };
+
+    std::unordered_map<std::uint16_t, posting_list> lists_;
+    replay_stamp source_;
+
+    static bool decode(
+      std::span<const std::byte> encoded, std::uint32_t count, std::vector<packet_location>& out
+    ) {
+      std::size_t pos = 0;
+      packet_location location{};
+      for (std::uint32_t i = 0; i < count; ++i) {
+        std::optional<std::uint64_t> index_delta = read_varint(encoded, pos);
+        std::optional<std::uint64_t> offset_delta = read_varint(encoded, pos);
+        std::optional<std::uint64_t> timestamp_delta = read_varint(encoded, pos);
+        if (!index_delta || !offset_delta || !timestamp_delta) {
+          return false;
+        }
+        location.packet_index += static_cast<std::uint32_t>(*index_delta);
+        location.decompressed_offset += *offset_delta;
+        location.timestamp_ms += static_cast<std::uint32_t>(zigzag_decode(*timestamp_delta));
+        out.push_back(location);
+      }
+      return true;
+    }
+  };
+
+  export object_index build_object_index(std::istream& compressed_stream) {
+    packet_filter mpi_only;
+    mpi_only.types.set(static_cast<std::uint8_t>(packet_type::mpi));
+    mpi_only.filter_types = true;
+
+    object_index index;
+    for (const packet_view& packet : packets(compressed_stream, mpi_only)) {
+      if (!packet.header) {
+        continue;
+      }
+      if (std::optional<mpi_message> mpi = read_mpi_message(packet.payload())) {
+        index.add(
+          mpi->object_id, {packet.index, packet.decompressed_offset, packet.header->timestamp_ms}
+        );
+      }
+    }
+    return index;
+  }
+
+  // Frames only the indexed packets of one object. Everything in between is inflated and dropped
+  // without being copied out, parsed or printed.
+  export void process_object(
+    std::istream& compressed_stream, const object_index& index, std::uint16_t object_id
+  ) {
+    std::vector<packet_location> locations = index.find(object_id);
+    std::println("Object 0x{:04X}: {} indexed packets", object_id, locations.size());
+
+    packet_framer framer(compressed_stream);
+    for (const packet_location& location : locations) {
+      if (!framer.seek(
+            location.decompressed_offset, location.packet_index, location.timestamp_ms
+          )) {
+        std::println(stderr, "Could not seek to packet {}. Stale index?", location.packet_index);
+        return;
+      }
+      auto packet = framer.next_view();
+      if (!packet) {
+        std::println(
+          stderr, "Could not read packet {}: {}", location.packet_index, packet.error().message()
+        );
+        return;
+      }
+      if (!*packet) {
+        std::println(stderr, "Could not read packet {}. Stale index?", location.packet_index);
+        return;
+      }
+      print_packet(**packet);
+    }
+  }
+
+} // namespace wrpl
@@ -0,0 +1,159 @@
+module;
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <istream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <system_error>
+#include <utility>
+
+export module packet_stream;
+
+import parser;
+
+namespace wrpl {
+
+  // Minimal input-range coroutine generator. Yielded values are handed out by reference to the
+  // coroutine's own storage, so a yield never copies or allocates; the only allocation is the
+  // coroutine frame. Stands in for std::generator, which not every standard library we build
+  // against (notably the one shipped with Emscripten) provides yet.
+  export template <typename T>
+  class generator {
+public:
+    struct promise_type {
+      const T* current = nullptr;
+      std::exception_ptr exception;
+
+      generator get_return_object() {
+        return generator{std::coroutine_handle<promise_type>::from_promise(*this)};
+      }
+
+      std::suspend_always initial_suspend() noexcept {
+        return {};
+      }
+
+      std::suspend_always final_suspend() noexcept {
+        return {};
+      }
+
+      std::suspend_always yield_value(const T& value) noexcept {
+        current = std::addressof(value);
+        return {};
+      }
+
+      void return_void() noexcept {
+      }
+
+      // The framing path reports errors as values; this only matters when a consumer's own code
+      // throws, and builds without exceptions never get here.
+      void unhandled_exception() {
+        exception = std::current_exception();
+      }
+    };
+
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    class iterator {
+  public:
+      using value_type = T;
+      using difference_type = std::ptrdiff_t;
+
+      iterator() = default;
+
+      explicit iterator(handle_type handle) : handle_{handle} {
+      }
+
+      const T& operator*() const {
+        return *handle_.promise().current;
+      }
+
+      iterator& operator++() {
+        resume(handle_);
+        return *this;
+      }
+
+      void operator++(int) {
+        ++*this;
+      }
+
+      bool operator==(std::default_sentinel_t) const {
+        return !handle_ || handle_.done();
+      }
+
+  private:
+      handle_type handle_;
+    };
+
+    explicit generator(handle_type handle) : handle_{handle} {
+    }
+
+    generator(generator&& other) noexcept : handle_{std::exchange(other.handle_, {})} {
+    }
+
+    generator& operator=(generator&& other) noexcept {
+      if (this != &other) {
+        if (handle_) {
+          handle_.destroy();
+        }
+        handle_ = std::exchange(other.handle_, {});
+      }
+      return *this;
+    }
+
+    generator(const generator&) = delete;
+    generator& operator=(const generator&) = delete;
+
+    ~generator() {
+      if (handle_) {
+        handle_.destroy();
+      }
+    }
+
+    iterator begin() {
+      resume(handle_);
+      return iterator{handle_};
+    }
+
+    std::default_sentinel_t end() {
+      return {};
+    }
+
+private:
+    handle_type handle_;
+
+    static void resume(handle_type handle) {
+      handle.resume();
+#if defined(__cpp_exceptions)
+      if (handle.promise().exception) {
+        std::rethrow_exception(std::exchange(handle.promise().exception, {}));
+      }
+#endif
+    }
+  };
+
+  // Lazily frames `compressed_stream`, which must outlive the generator. Each packet_view is valid
+  // until the consumer advances; stopping early simply stops inflating. A framing or inflate
+  // failure ends the range and, if `error` is given, is stored there.
+  export generator<packet_view> packets(
+    std::istream& compressed_stream, packet_filter filter = {}, std::error_code* error = nullptr
+  ) {
+    packet_framer framer(compressed_stream, filter);
+    while (true) {
+      auto packet = framer.next_view();
+      if (!packet) {
+        if (error) {
+          *error = packet.error();
+        }
+        co_return;
+      }
+      if (!*packet) {
+        co_return;
+      }
+      co_yield **packet;
+    }
+  }
+
+} // namespace wrpl
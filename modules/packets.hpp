@@ -1,338 +1,351 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
 #include <cstdint>
 #include <optional>
 #include <string_view>
 
 namespace packet_ids {
 
-  constexpr std::optional<std::string_view> get_name(uint16_t id) {
-    switch (id) {
-      case 0xB00C:
-        return "InfTroopSync";
-      case 0xB00E:
-        return "ReplicatedObjectCreate";
-      case 0xB013:
-        return "DoFlakExplosion";
-      case 0xB01D:
-        return "SemChangeAircraftRequest";
-      case 0xB01E:
-        return "PpChangeAircraftResponse";
-      case 0xB02C:
-        return "SetTimeSpeedEx";
-      case 0xB062:
-        return "SpectateRequestId";
-      case 0xB063:
-        return "ControlsConfirmation";
-      case 0xB065:
-        return "FmwControlsPacket";
-      case 0xB066:
-        return "FmwAuthorityApprovedState";
-      case 0xB068:
-        return "MissionEvent";
-      case 0xB06E:
-        return "UnitBulletHitPartCount";
-      case 0xB07B:
-        return "MissionProgressDataReceived";
-      case 0xB07D:
-        return "MissionProgressTimeDataReceived";
-      case 0xB08B:
-        return "VehicleControlsPacket";
-      case 0xB08C:
-        return "VehicleAuthorityApprovedState";
-      case 0xB091:
-        return "AppUnitVersionMismatch";
-      case 0xB092:
-        return "AppUnitVersionMatch";
-      case 0xB095:
-        return "GmDesyncStats";
-      case 0xB097:
-        return "GmDoEscape";
-      case 0xB0A8:
-        return "UnitDesyncData";
-      case 0xB0C5:
-        return "UnitRequestWinch";
-      case 0xB0CE:
-        return "WalkerControlsPacket";
-      case 0xB0D1:
-        return "ResponseChallenge";
-      case 0xB0D3:
-        return "ShowUpObjToTeamResponse";
-      case 0xB0D4:
-        return "ShowUpObjToTeamRequest";
-      case 0xB0DC:
-        return "RocketControlsPacket";
-      case 0xB0E5:
-        return "ConfirmAuthorityApprovedState";
-      case 0xB0F5:
-        return "UnitHighlight";
-      case 0xB107:
-        return "EACClientToServerMsg";
-      case 0xB11D:
-        return "CloudsTracesData";
-      case 0xB12E:
-        return "TerraformIntegrityCheckDataRequest";
-      case 0xB145:
-        return "HumanControlsPacket";
-      case 0xD01F:
-        return "PlayFlakExplosionVisual";
-      case 0xD020:
-        return "GmSetGunAngles";
-      case 0xD039:
-        return "DeferredReplicatedObjectCreate";
-      case 0xD043:
-        return "ReplayCameraParams";
-      case 0xD046:
-        return "UnitReloadGun";
-      case 0xD047:
-        return "FmwRpm";
-      case 0xD04A:
-        return "ReplayCockpitParams";
-      case 0xD08E:
-        return "PlayExplosionVisual";
-      case 0xD0AD:
-        return "UnitDelayedStatusChange";
-      case 0xD0FE:
-        return "ProjectileHitReplay";
-      case 0xD136:
-        return "DeferredReflectionData";
-      case 0xD137:
-        return "UnitDataSnapshot";
-      case 0xD146:
-        return "ReplayVrHandsState";
-      case 0xF016:
-        return "GmGroundExplosionSmokeEffect";
-      case 0xF017:
-        return "GmGroundExplosionFireEffect";
-      case 0xF018:
-        return "GmDoInactive";
-      case 0xF01A:
-        return "GmDoSingleShotReliable";
-      case 0xF01C:
-        return "GmDoStopFire";
-      case 0xF026:
-        return "TurretYawImmobile";
-      case 0xF027:
-        return "TurretPitchImmobile";
-      case 0xF028:
-        return "RunTriggerAction";
-      case 0xF02D:
-        return "ReflectionData";
-      case 0xF02F:
-        return "UnitRequestRespawn";
-      case 0xF032:
-        return "UnitRequestRepair";
-      case 0xF033:
-        return "UnitRepair";
-      case 0xF037:
-        return "UnitDetected";
-      case 0xF038:
-        return "OwnerPlayerViewDirection";
-      case 0xF03B:
-        return "HintPlayFromScript";
-      case 0xF04B:
-        return "OnUnitDead";
-      case 0xF04D:
-        return "UnitDoExplosion";
-      case 0xF050:
-        return "UnitBailoutResponse";
-      case 0xF053:
-        return "UnitRequestRearm";
-      case 0xF054:
-        return "UnitRearm";
-      case 0xF055:
-        return "MissionFailOrSuccess";
-      case 0xF056:
-        return "TextCriticalHitReport";
-      case 0xF058:
-        return "TextKillReport";
-      case 0xF05D:
-        return "FadeToDebriefing";
-      case 0xF06A:
-        return "DialogMessageAction";
-      case 0xF06B:
-        return "ResetGroundModelPositionDeltas";
-      case 0xF071:
-        return "UnitReloadGuns";
-      case 0xF073:
-        return "GroundModelPositions";
-      case 0xF074:
-        return "GroundModelPositionsServerReplay";
-      case 0xF078:
-        return "TextStreak";
-      case 0xF07A:
-        return "MissionProgressData";
-      case 0xF07C:
-        return "MissionProgressTimeData";
-      case 0xF08D:
-        return "FmwAuthorityApprovedPartialState";
-      case 0xF091:
-        return "GmCutPartResponse";
-      case 0xF099:
-        return "PlayLandcrashExplosions";
-      case 0xF09A:
-        return "DvmUnreliableHpReflectionData";
-      case 0xF09B:
-        return "DvmUnreliableHpReflectionReply";
-      case 0xF09C:
-        return "EconUpdateWeapon";
-      case 0xF0A0:
-        return "GmDoSingleShotUnreliable";
-      case 0xF0A3:
-        return "VehicleAuthorityApprovedPartialState";
-      case 0xF0A6:
-        return "UnitArtilleryShootingAtPos";
-      case 0xF0AA:
-        return "RedundancyReflectionData";
-      case 0xF0AB:
-        return "DvmCutDecor";
-      case 0xF0B1:
-        return "UnitSingleShot";
-      case 0xF0B3:
-        return "DebugSphere";
-      case 0xF0B6:
-        return "SmartCutsceneFinished";
-      case 0xF0B8:
-        return "PlayAreaEffects";
-      case 0xF0BB:
-        return "UnitRequestDamageModelEvents";
-      case 0xF0BC:
-        return "UnitResponseDamageModelEvents";
-      case 0xF0BD:
-        return "UnitBulletRearm";
-      case 0xF0C2:
-        return "UnitLastEffectiveHit";
-      case 0xF0C3:
-        return "MessageStartGame";
-      case 0xF0C8:
-        return "UseOrderRequest";
-      case 0xF0CA:
-        return "UnitRequestRepairAssist";
-      case 0xF0CB:
-        return "DvmDamageDataForReferee";
-      case 0xF0D2:
-        return "OrderResult";
-      case 0xF0D5:
-        return "UnitToggleGunners";
-      case 0xF0D6:
-        return "GmDoStartFireWithDist";
-      case 0xF0D8:
-        return "HudMarkMapSquare";
-      case 0xF0DB:
-        return "ShellsData";
-      case 0xF0DD:
-        return "GmRequestToggleCurWeapon";
-      case 0xF0DF:
-        return "CustomWeatherParams";
-      case 0xF0E1:
-        return "GmRequestChangeCrew";
-      case 0xF0E2:
-        return "GmRequestRepair";
-      case 0xF0E3:
-        return "RocketAuthorityApprovedState";
-      case 0xF0E6:
-        return "GmApplyExplosionImpulse";
-      case 0xF0E9:
-        return "UnitHitEffects";
-      case 0xF0EC:
-        return "MissionPlayHint";
-      case 0xF0ED:
-        return "UnitPickupItem";
-      case 0xF0F0:
-        return "UnitSetTimeFuseDistance";
-      case 0xF0F6:
-        return "UnitScoutResult";
-      case 0xF0F7:
-        return "InteractiveObjectAuthorityApprovedState";
-      case 0xF0F8:
-        return "InteractiveObjectAuthorityApprovedPartialState";
-      case 0xF0F9:
-        return "UnitRefuel";
-      case 0xF0FD:
-        return "UnitRequestChangeShotFreq";
-      case 0xF101:
-        return "UnitRequestRepairWithoutMod";
-      case 0xF103:
-        return "ConsoleUnitCommand";
-      case 0xF104:
-        return "TextHitReport";
-      case 0xF109:
-        return "GmEngineOnOff";
-      case 0xF10A:
-        return "UnitChangeNightVision";
-      case 0xF10C:
-        return "RecreateTorpedoes";
-      case 0xF10F:
-        return "SquadTargetDesignationRequest";
-      case 0xF118:
-        return "UnitDamagePartKill";
-      case 0xF119:
-        return "GmToggleOptics";
-      case 0xF11A:
-        return "ShellsDataServerReplay";
-      case 0xF11E:
-        return "UnitRequestSwitchOnSupport";
-      case 0xF11F:
-        return "GmRequestToggleStealth";
-      case 0xF120:
-        return "UnitFriendlyFire";
-      case 0xF121:
-        return "ActiveProtectionSystemTriggering";
-      case 0xF122:
-        return "TerraformPatchAlt";
-      case 0xF123:
-        return "TerraformData";
-      case 0xF124:
-        return "GmToggleTerraform";
-      case 0xF125:
-        return "GmDoWeaponLockOnReliable";
-      case 0xF126:
-        return "GmDoWeaponLockOnUnreliable";
-      case 0xF127:
-        return "UnitRequestExtinguishAssist";
-      case 0xF128:
-        return "UnitRequestExtinguishWithoutMod";
-      case 0xF129:
-        return "UnitResponseSwitchOnSupport";
-      case 0xF12C:
-        return "ECSNetUnitsData";
-      case 0xF12D:
-        return "ECSNetUnitsDataServerReplay";
-      case 0xF12F:
-        return "TerraformIntegrityCheckDataResponce";
-      case 0xF130:
-        return "UnitSmokeScreen";
-      case 0xF131:
-        return "UnitChangeCurShortcut";
-      case 0xF132:
-        return "ShotFailedApsWorking";
-      case 0xF133:
-        return "UnitOnExplosion";
-      case 0xF134:
-        return "UnitRequestChangeSupportPlane";
-      case 0xF135:
-        return "UnitSupportPlaneAttackCommand";
-      case 0xF13B:
-        return "DvmDamageDataForReplay";
-      case 0xF13D:
-        return "GmCutAllWreckedParts";
-      case 0xF140:
-        return "UnitRequestUnlimitedControl";
-      case 0xF142:
-        return "TargetDesignationMark";
-      case 0xF143:
-        return "SetBenchmarkMode";
-      case 0xF144:
-        return "UnitOnHit";
-      case 0xF147:
-        return "UnitDoProximityExplosion";
-      case 0xF148:
-        return "ForceMusic";
-      case 0xF08F:
-        return "UnitAttachEffectRelative";
-      default:
-        return std::nullopt;
+  // What the body after the MPI header looks like, as far as it is known.
+  enum class payload_shape : std::uint8_t {
+    opaque,
+    // fields at fixed offsets
+    fixed_layout,
+    // u8 record count followed by fixed-size records
+    counted_records,
+  };
+
+  struct message_info {
+    std::uint16_t id = 0;
+    std::string_view name;
+    payload_shape shape = payload_shape::opaque;
+  };
+
+  // Sorted by id. Ids share a handful of high bytes (0xB0, 0xD0, 0xF0, ...), which the lookup
+  // tables below use as families.
+  inline constexpr auto messages = std::to_array<message_info>({
+    {0xB00C, "InfTroopSync"},
+    {0xB00E, "ReplicatedObjectCreate"},
+    {0xB013, "DoFlakExplosion"},
+    {0xB01D, "SemChangeAircraftRequest"},
+    {0xB01E, "PpChangeAircraftResponse"},
+    {0xB02C, "SetTimeSpeedEx"},
+    {0xB062, "SpectateRequestId"},
+    {0xB063, "ControlsConfirmation"},
+    {0xB065, "FmwControlsPacket"},
+    {0xB066, "FmwAuthorityApprovedState"},
+    {0xB068, "MissionEvent"},
+    {0xB06E, "UnitBulletHitPartCount"},
+    {0xB07B, "MissionProgressDataReceived"},
+    {0xB07D, "MissionProgressTimeDataReceived"},
+    {0xB08B, "VehicleControlsPacket"},
+    {0xB08C, "VehicleAuthorityApprovedState"},
+    {0xB091, "AppUnitVersionMismatch"},
+    {0xB092, "AppUnitVersionMatch"},
+    {0xB095, "GmDesyncStats"},
+    {0xB097, "GmDoEscape"},
+    {0xB0A8, "UnitDesyncData"},
+    {0xB0C5, "UnitRequestWinch"},
+    {0xB0CE, "WalkerControlsPacket"},
+    {0xB0D1, "ResponseChallenge"},
+    {0xB0D3, "ShowUpObjToTeamResponse"},
+    {0xB0D4, "ShowUpObjToTeamRequest"},
+    {0xB0DC, "RocketControlsPacket"},
+    {0xB0E5, "ConfirmAuthorityApprovedState"},
+    {0xB0F5, "UnitHighlight"},
+    {0xB107, "EACClientToServerMsg"},
+    {0xB11D, "CloudsTracesData"},
+    {0xB12E, "TerraformIntegrityCheckDataRequest"},
+    {0xB145, "HumanControlsPacket"},
+    {0xD01F, "PlayFlakExplosionVisual"},
+    {0xD020, "GmSetGunAngles"},
+    {0xD039, "DeferredReplicatedObjectCreate"},
+    {0xD043, "ReplayCameraParams"},
+    {0xD046, "UnitReloadGun"},
+    {0xD047, "FmwRpm"},
+    {0xD04A, "ReplayCockpitParams"},
+    {0xD08E, "PlayExplosionVisual"},
+    {0xD0AD, "UnitDelayedStatusChange"},
+    {0xD0FE, "ProjectileHitReplay"},
+    {0xD136, "DeferredReflectionData"},
+    {0xD137, "UnitDataSnapshot"},
+    {0xD146, "ReplayVrHandsState"},
+    {0xF016, "GmGroundExplosionSmokeEffect"},
+    {0xF017, "GmGroundExplosionFireEffect"},
+    {0xF018, "GmDoInactive"},
+    {0xF01A, "GmDoSingleShotReliable"},
+    {0xF01C, "GmDoStopFire"},
+    {0xF026, "TurretYawImmobile"},
+    {0xF027, "TurretPitchImmobile"},
+    {0xF028, "RunTriggerAction"},
+    {0xF02D, "ReflectionData"},
+    {0xF02F, "UnitRequestRespawn"},
+    {0xF032, "UnitRequestRepair"},
+    {0xF033, "UnitRepair"},
+    {0xF037, "UnitDetected"},
+    {0xF038, "OwnerPlayerViewDirection"},
+    {0xF03B, "HintPlayFromScript"},
+    {0xF04B, "OnUnitDead"},
+    {0xF04D, "UnitDoExplosion"},
+    {0xF050, "UnitBailoutResponse"},
+    {0xF053, "UnitRequestRearm"},
+    {0xF054, "UnitRearm"},
+    {0xF055, "MissionFailOrSuccess"},
+    {0xF056, "TextCriticalHitReport"},
+    {0xF058, "TextKillReport"},
+    {0xF05D, "FadeToDebriefing"},
+    {0xF06A, "DialogMessageAction"},
+    {0xF06B, "ResetGroundModelPositionDeltas"},
+    {0xF071, "UnitReloadGuns"},
+    {0xF073, "GroundModelPositions"},
+    {0xF074, "GroundModelPositionsServerReplay"},
+    {0xF078, "TextStreak"},
+    {0xF07A, "MissionProgressData"},
+    {0xF07C, "MissionProgressTimeData"},
+    {0xF08D, "FmwAuthorityApprovedPartialState"},
+    {0xF08F, "UnitAttachEffectRelative"},
+    {0xF091, "GmCutPartResponse"},
+    {0xF099, "PlayLandcrashExplosions"},
+    {0xF09A, "DvmUnreliableHpReflectionData"},
+    {0xF09B, "DvmUnreliableHpReflectionReply"},
+    {0xF09C, "EconUpdateWeapon"},
+    {0xF0A0, "GmDoSingleShotUnreliable"},
+    {0xF0A3, "VehicleAuthorityApprovedPartialState"},
+    {0xF0A6, "UnitArtilleryShootingAtPos"},
+    {0xF0AA, "RedundancyReflectionData"},
+    {0xF0AB, "DvmCutDecor"},
+    {0xF0B1, "UnitSingleShot"},
+    {0xF0B3, "DebugSphere"},
+    {0xF0B6, "SmartCutsceneFinished"},
+    {0xF0B8, "PlayAreaEffects"},
+    {0xF0BB, "UnitRequestDamageModelEvents"},
+    {0xF0BC, "UnitResponseDamageModelEvents"},
+    {0xF0BD, "UnitBulletRearm"},
+    {0xF0C2, "UnitLastEffectiveHit"},
+    {0xF0C3, "MessageStartGame"},
+    {0xF0C8, "UseOrderRequest"},
+    {0xF0CA, "UnitRequestRepairAssist"},
+    {0xF0CB, "DvmDamageDataForReferee"},
+    {0xF0D2, "OrderResult"},
+    {0xF0D5, "UnitToggleGunners"},
+    {0xF0D6, "GmDoStartFireWithDist"},
+    {0xF0D8, "HudMarkMapSquare"},
+    {0xF0DB, "ShellsData"},
+    {0xF0DD, "GmRequestToggleCurWeapon"},
+    {0xF0DF, "CustomWeatherParams"},
+    {0xF0E1, "GmRequestChangeCrew"},
+    {0xF0E2, "GmRequestRepair"},
+    {0xF0E3, "RocketAuthorityApprovedState"},
+    {0xF0E6, "GmApplyExplosionImpulse"},
+    {0xF0E9, "UnitHitEffects"},
+    {0xF0EC, "MissionPlayHint"},
+    {0xF0ED, "UnitPickupItem"},
+    {0xF0F0, "UnitSetTimeFuseDistance"},
+    {0xF0F6, "UnitScoutResult"},
+    {0xF0F7, "InteractiveObjectAuthorityApprovedState"},
+    {0xF0F8, "InteractiveObjectAuthorityApprovedPartialState"},
+    {0xF0F9, "UnitRefuel"},
+    {0xF0FD, "UnitRequestChangeShotFreq"},
+    {0xF101, "UnitRequestRepairWithoutMod"},
+    {0xF103, "ConsoleUnitCommand"},
+    {0xF104, "TextHitReport"},
+    {0xF109, "GmEngineOnOff"},
+    {0xF10A, "UnitChangeNightVision"},
+    {0xF10C, "RecreateTorpedoes"},
+    {0xF10F, "SquadTargetDesignationRequest"},
+    {0xF118, "UnitDamagePartKill"},
+    {0xF119, "GmToggleOptics"},
+    {0xF11A, "ShellsDataServerReplay"},
+    {0xF11E, "UnitRequestSwitchOnSupport"},
+    {0xF11F, "GmRequestToggleStealth"},
+    {0xF120, "UnitFriendlyFire"},
+    {0xF121, "ActiveProtectionSystemTriggering"},
+    {0xF122, "TerraformPatchAlt"},
+    {0xF123, "TerraformData"},
+    {0xF124, "GmToggleTerraform"},
+    {0xF125, "GmDoWeaponLockOnReliable"},
+    {0xF126, "GmDoWeaponLockOnUnreliable"},
+    {0xF127, "UnitRequestExtinguishAssist"},
+    {0xF128, "UnitRequestExtinguishWithoutMod"},
+    {0xF129, "UnitResponseSwitchOnSupport"},
+    {0xF12C, "ECSNetUnitsData"},
+    {0xF12D, "ECSNetUnitsDataServerReplay"},
+    {0xF12F, "TerraformIntegrityCheckDataResponce"},
+    {0xF130, "UnitSmokeScreen"},
+    {0xF131, "UnitChangeCurShortcut"},
+    {0xF132, "ShotFailedApsWorking"},
+    {0xF133, "UnitOnExplosion"},
+    {0xF134, "UnitRequestChangeSupportPlane"},
+    {0xF135, "UnitSupportPlaneAttackCommand"},
+    {0xF13B, "DvmDamageDataForReplay"},
+    {0xF13D, "GmCutAllWreckedParts"},
+    {0xF140, "UnitRequestUnlimitedControl"},
+    {0xF142, "TargetDesignationMark"},
+    {0xF143, "SetBenchmarkMode"},
+    {0xF144, "UnitOnHit"},
+    {0xF147, "UnitDoProximityExplosion"},
+    {0xF148, "ForceMusic"},
+  });
+
+  namespace detail {
+
+    inline constexpr std::uint16_t no_entry = 0xFFFF;
+    inline constexpr std::uint8_t no_family = 0xFF;
+
+    constexpr std::size_t count_families() {
+      std::array<bool, 256> seen{};
+      std::size_t count = 0;
+      for (const message_info& message : messages) {
+        if (!seen[message.id >> 8]) {
+          seen[message.id >> 8] = true;
+          count++;
+        }
+      }
+      return count;
+    }
+
+    // One 256-entry table of catalog indices per family, selected by the id's high byte.
+    struct id_table {
+      std::array<std::uint8_t, 256> family_slot{};
+      std::array<std::array<std::uint16_t, 256>, count_families()> entries{};
+      bool unique = true;
+    };
+
+    constexpr id_table build_id_table() {
+      id_table table;
+      table.family_slot.fill(no_family);
+      for (auto& family : table.entries) {
+        family.fill(no_entry);
+      }
+      std::uint8_t next_slot = 0;
+      for (std::size_t i = 0; i < messages.size(); ++i) {
+        std::uint8_t& slot = table.family_slot[messages[i].id >> 8];
+        if (slot == no_family) {
+          slot = next_slot++;
+        }
+        std::uint16_t& entry = table.entries[slot][messages[i].id & 0xFF];
+        table.unique = table.unique && entry == no_entry;
+        entry = static_cast<std::uint16_t>(i);
+      }
+      return table;
     }
+
+    inline constexpr id_table ids = build_id_table();
+    static_assert(ids.unique, "duplicate message id in the catalog");
+
+    constexpr std::uint32_t hash_name(std::string_view name, std::uint32_t seed) {
+      std::uint32_t hash = 2166136261u ^ (seed * 0x9E3779B9u);
+      for (char c : name) {
+        hash = (hash ^ static_cast<std::uint8_t>(c)) * 16777619u;
+      }
+      return hash ^ (hash >> 15);
+    }
+
+    inline constexpr std::size_t name_buckets = 64;
+    inline constexpr std::size_t name_slots = 512;
+    static_assert(name_slots >= 2 * messages.size());
+
+    // Hash and displace: a name's first hash picks a bucket, and the bucket's displacement seeds
+    // the second hash that picks its slot. Displacements are searched at compile time so that no
+    // two names share a slot, which makes a lookup one probe and one string compare.
+    struct name_table {
+      std::array<std::uint16_t, name_buckets> displacement{};
+      std::array<std::uint16_t, name_slots> slots{};
+      bool complete = true;
+    };
+
+    constexpr std::size_t name_slot(std::string_view name, std::uint16_t displacement) {
+      return hash_name(name, displacement + 1u) % name_slots;
+    }
+
+    constexpr name_table build_name_table() {
+      name_table table;
+      table.slots.fill(no_entry);
+
+      std::array<std::array<std::uint16_t, messages.size()>, name_buckets> members{};
+      std::array<std::size_t, name_buckets> member_count{};
+      for (std::size_t i = 0; i < messages.size(); ++i) {
+        std::size_t bucket = hash_name(messages[i].name, 0) % name_buckets;
+        members[bucket][member_count[bucket]++] = static_cast<std::uint16_t>(i);
+      }
+
+      // the fullest buckets are placed first, while most slots are still free
+      std::array<std::size_t, name_buckets> order{};
+      for (std::size_t i = 0; i < name_buckets; ++i) {
+        order[i] = i;
+      }
+      std::ranges::sort(order, [&](std::size_t a, std::size_t b) {
+        return member_count[a] > member_count[b];
+      });
+
+      for (std::size_t bucket : order) {
+        std::size_t count = member_count[bucket];
+        if (count == 0) {
+          break;
+        }
+        bool placed = false;
+        for (std::uint32_t displacement = 0; displacement < no_entry && !placed; ++displacement) {
+          std::array<std::size_t, messages.size()> chosen{};
+          placed = true;
+          for (std::size_t k = 0; k < count && placed; ++k) {
+            chosen[k] = name_slot(
+              messages[members[bucket][k]].name, static_cast<std::uint16_t>(displacement)
+            );
+            placed = table.slots[chosen[k]] == no_entry &&
+                     std::find(chosen.begin(), chosen.begin() + k, chosen[k]) ==
+                       chosen.begin() + k;
+          }
+          if (placed) {
+            table.displacement[bucket] = static_cast<std::uint16_t>(displacement);
+            for (std::size_t k = 0; k < count; ++k) {
+              table.slots[chosen[k]] = members[bucket][k];
+            }
+          }
+        }
+        table.complete = table.complete && placed;
+      }
+      return table;
+    }
+
+    inline constexpr name_table names = build_name_table();
+    static_assert(names.complete, "no collision-free displacement for the message names");
+
+  } // namespace detail
+
+  // O(1): the id's high byte selects a family table, the low byte the entry.
+  constexpr const message_info* find(std::uint16_t id) {
+    std::uint8_t slot = detail::ids.family_slot[id >> 8];
+    if (slot == detail::no_family) {
+      return nullptr;
+    }
+    std::uint16_t entry = detail::ids.entries[slot][id & 0xFF];
+    return entry == detail::no_entry ? nullptr : &messages[entry];
   }
 
+  constexpr std::optional<std::string_view> get_name(std::uint16_t id) {
+    const message_info* message = find(id);
+    if (!message) {
+      return std::nullopt;
+    }
+    return message->name;
+  }
+
+  // Exact, case-sensitive match against the catalog names.
+  constexpr std::optional<std::uint16_t> find_id(std::string_view name) {
+    std::size_t bucket = detail::hash_name(name, 0) % detail::name_buckets;
+    std::uint16_t entry =
+      detail::names.slots[detail::name_slot(name, detail::names.displacement[bucket])];
+    if (entry == detail::no_entry || messages[entry].name != name) {
+      return std::nullopt;
+    }
+    return messages[entry].id;
+  }
+
+  static_assert(std::ranges::all_of(messages, [](const message_info& message) {
+    return find(message.id) == &message && find_id(message.name) == message.id;
+  }));
+
 } // namespace packet_ids
@@ -3,28 +3,37 @@ module;
 #include <print>
 #include <zlib.h>
 
+#include <algorithm>
+#include <array>
 #include <bit>
+#include <bitset>
+#include <charconv>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <deque>
-#include <exception>
+#include <expected>
 #include <format>
 #include <istream>
+#include <limits>
 #include <optional>
 #include <span>
-#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
 #include <vector>
 #include "packets.hpp"
 
 export module parser;
 
 import deserializer;
+import memory_stats;
+import trace;
 
 namespace wrpl {
 
-  enum class packet_type : std::uint8_t {
+  export enum class packet_type : std::uint8_t {
     end_marker = 0,
     start_marker = 1,
     aircraft_small = 2,
@@ -36,7 +45,7 @@ namespace wrpl {
     replay_header_info = 8,
   };
 
-  std::string get_packet_type_name(std::uint8_t type_val) {
+  export constexpr std::optional<std::string_view> get_packet_type_name(std::uint8_t type_val) {
     switch (static_cast<packet_type>(type_val)) {
       case packet_type::end_marker:
         return "end_marker";
@@ -57,10 +66,105 @@ namespace wrpl {
       case packet_type::replay_header_info:
         return "replay_header_info";
       default:
-        return std::format("unknown ({})", type_val);
+        return std::nullopt;
     }
   }
 
+  export enum class parse_error {
+    inflate_init_failed = 1,
+    inflate_failed,
+    truncated_prefix,
+    invalid_prefix,
+    empty_payload,
+    stream_not_found,
+    truncated_stream,
+  };
+
+  class parse_error_category : public std::error_category {
+public:
+    const char* name() const noexcept override {
+      return "wrpl_parse";
+    }
+
+    std::string message(int ev) const override {
+      switch (static_cast<parse_error>(ev)) {
+        case parse_error::inflate_init_failed:
+          return "zlib inflateInit failed";
+        case parse_error::inflate_failed:
+          return "zlib inflate error";
+        case parse_error::truncated_prefix:
+          return "could not read packet size prefix despite not being at EOF";
+        case parse_error::invalid_prefix:
+          return "invalid packet size prefix";
+        case parse_error::empty_payload:
+          return "no payload data read";
+        case parse_error::stream_not_found:
+          return "zlib stream not found";
+        case parse_error::truncated_stream:
+          return "zlib stream ends before its final block";
+        default:
+          return "unknown parse error";
+      }
+    }
+  };
+
+  export const std::error_category& get_parse_error_category() {
+    static parse_error_category instance;
+    return instance;
+  }
+
+  export std::error_code make_error_code(parse_error e) {
+    return {static_cast<int>(e), get_parse_error_category()};
+  }
+
+} // namespace wrpl
+
+// declared before the framer so parse_error converts to std::error_code inside this module too
+namespace std {
+  template <>
+  struct is_error_code_enum<wrpl::parse_error> : true_type {};
+} // namespace std
+
+namespace wrpl {
+
+  // Read-only istream over bytes that are already in memory, so replays and segments can be
+  // inflated without first being copied into a stringstream.
+  export class memory_istream : public std::istream {
+public:
+    explicit memory_istream(std::span<const std::byte> data) :
+        std::istream(nullptr), buffer_{data} {
+      rdbuf(&buffer_);
+    }
+
+private:
+    class buffer : public std::streambuf {
+  public:
+      explicit buffer(std::span<const std::byte> data) {
+        char* begin = const_cast<char*>(reinterpret_cast<const char*>(data.data()));
+        setg(begin, begin, begin + data.size());
+      }
+
+  protected:
+      pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) override {
+        off_type base = dir == std::ios_base::beg   ? 0
+                        : dir == std::ios_base::cur ? gptr() - eback()
+                                                    : egptr() - eback();
+        return seekpos(pos_type(base + off), std::ios_base::in);
+      }
+
+      pos_type seekpos(pos_type pos, std::ios_base::openmode) override {
+        off_type offset = pos;
+        if (offset < 0 || offset > egptr() - eback()) {
+          return pos_type(off_type(-1));
+        }
+        setg(eback(), eback() + offset, egptr());
+        return pos;
+      }
+    };
+
+    buffer buffer_;
+  };
+
   class byte_stream_reader {
 public:
     byte_stream_reader(std::span<const std::byte> data) : data_{data} {
@@ -84,6 +188,133 @@ private:
     std::size_t position_ = 0;
   };
 
+  // Everything needed to resume framing mid-stream without inflating from the start again. A
+  // deflate stream can only be re-entered at a block boundary, so this holds the last boundary
+  // before the framing position (input offset, unused bits and the 32 KiB window that later
+  // blocks may reference) plus the inflated bytes between that boundary and the framer.
+  export struct decoder_checkpoint {
+    static constexpr std::uint32_t MAGIC = 0x32435057; // "WPC2"
+
+    // size and mtime of the replay the checkpoint was taken from, so it is never resumed against
+    // another or a rewritten file; left to the caller, since the framer only sees a stream
+    std::uint64_t source_size = 0;
+    std::int64_t source_modified = 0;
+    // byte offset into the zlib stream; 0 means the very start, before the zlib header
+    std::uint64_t compressed_offset = 0;
+    // bits of the byte before `compressed_offset` that still belong to the next block
+    std::uint8_t bits = 0;
+    // decompressed offset of the boundary
+    std::uint64_t boundary_offset = 0;
+    // decompressed offset the framer had reached
+    std::uint64_t decompressed_offset = 0;
+    std::uint32_t packet_index = 0;
+    std::uint32_t last_timestamp_ms = 0;
+    std::vector<std::byte> window;
+    // bytes from the boundary to the framer if the boundary was ahead of it
+    std::vector<std::byte> pending;
+
+    // The reader never inflates more than one 16 KiB chunk past what the framer asked for, so
+    // pending bytes stay below that; the limit leaves room without trusting a corrupt size.
+    static constexpr std::size_t max_pending_size = 64 * 1024;
+
+    // window and pending bytes are deflated, the rest is a fixed little endian header; nullopt if
+    // deflating them failed
+    std::optional<std::vector<std::byte>> serialize() const {
+      std::vector<std::byte> raw;
+      raw.reserve(window.size() + pending.size());
+      raw.insert(raw.end(), window.begin(), window.end());
+      raw.insert(raw.end(), pending.begin(), pending.end());
+      uLongf packed_size = compressBound(static_cast<uLong>(raw.size()));
+      std::vector<std::byte> packed(packed_size);
+      if (compress2(
+            reinterpret_cast<Bytef*>(packed.data()), &packed_size,
+            reinterpret_cast<const Bytef*>(raw.data()), static_cast<uLong>(raw.size()), Z_BEST_SPEED
+          ) != Z_OK) {
+        return std::nullopt;
+      }
+      packed.resize(packed_size);
+
+      std::vector<std::byte> out;
+      auto put = [&out](std::uint64_t value, std::size_t size) {
+        for (std::size_t i = 0; i < size; ++i) {
+          out.push_back(static_cast<std::byte>(value >> (8 * i)));
+        }
+      };
+      put(MAGIC, 4);
+      put(source_size, 8);
+      put(static_cast<std::uint64_t>(source_modified), 8);
+      put(compressed_offset, 8);
+      put(bits, 1);
+      put(boundary_offset, 8);
+      put(decompressed_offset, 8);
+      put(packet_index, 4);
+      put(last_timestamp_ms, 4);
+      put(window.size(), 4);
+      put(pending.size(), 4);
+      out.insert(out.end(), packed.begin(), packed.end());
+      return out;
+    }
+
+    static std::optional<decoder_checkpoint> deserialize(std::span<const std::byte> data) {
+      std::size_t pos = 0;
+      auto get = [&](std::size_t size) -> std::optional<std::uint64_t> {
+        if (data.size() - pos < size) {
+          return std::nullopt;
+        }
+        std::uint64_t value = 0;
+        for (std::size_t i = 0; i < size; ++i) {
+          value |= static_cast<std::uint64_t>(data[pos + i]) << (8 * i);
+        }
+        pos += size;
+        return value;
+      };
+      std::optional<std::uint64_t> magic = get(4);
+      std::optional<std::uint64_t> source_size = get(8);
+      std::optional<std::uint64_t> source_modified = get(8);
+      std::optional<std::uint64_t> compressed_offset = get(8);
+      std::optional<std::uint64_t> bits = get(1);
+      std::optional<std::uint64_t> boundary_offset = get(8);
+      std::optional<std::uint64_t> decompressed_offset = get(8);
+      std::optional<std::uint64_t> packet_index = get(4);
+      std::optional<std::uint64_t> last_timestamp_ms = get(4);
+      std::optional<std::uint64_t> window_size = get(4);
+      std::optional<std::uint64_t> pending_size = get(4);
+      if (!magic || !source_size || !source_modified || !compressed_offset || !bits ||
+          !boundary_offset || !decompressed_offset || !packet_index || !last_timestamp_ms ||
+          !window_size || !pending_size) {
+        return std::nullopt;
+      }
+      if (*magic != MAGIC || *bits > 7 || *window_size > 32 * 1024 ||
+          *pending_size > max_pending_size) {
+        return std::nullopt;
+      }
+
+      std::vector<std::byte> raw(*window_size + *pending_size);
+      uLongf raw_size = static_cast<uLongf>(raw.size());
+      std::span<const std::byte> packed = data.subspan(pos);
+      if (uncompress(
+            reinterpret_cast<Bytef*>(raw.data()), &raw_size,
+            reinterpret_cast<const Bytef*>(packed.data()), static_cast<uLong>(packed.size())
+          ) != Z_OK ||
+          raw_size != raw.size()) {
+        return std::nullopt;
+      }
+
+      decoder_checkpoint checkpoint;
+      checkpoint.source_size = *source_size;
+      checkpoint.source_modified = static_cast<std::int64_t>(*source_modified);
+      checkpoint.compressed_offset = *compressed_offset;
+      checkpoint.bits = static_cast<std::uint8_t>(*bits);
+      checkpoint.boundary_offset = *boundary_offset;
+      checkpoint.decompressed_offset = *decompressed_offset;
+      checkpoint.packet_index = static_cast<std::uint32_t>(*packet_index);
+      checkpoint.last_timestamp_ms = static_cast<std::uint32_t>(*last_timestamp_ms);
+      checkpoint.window.assign(raw.begin(), raw.begin() + *window_size);
+      checkpoint.pending.assign(raw.begin() + *window_size, raw.end());
+      return checkpoint;
+    }
+  };
+
   class decompressed_stream_reader {
 public:
     explicit decompressed_stream_reader(std::istream& compressed_stream) :
@@ -94,12 +325,78 @@ public:
       z_stream_.avail_in = 0;
       z_stream_.next_in = Z_NULL;
       if (inflateInit(&z_stream_) != Z_OK) {
-        throw std::runtime_error("zlib inflateInit failed");
+        error_ = parse_error::inflate_init_failed;
+        eof_compressed_ = true;
+        return;
+      }
+      initialized_ = true;
+    }
+
+    // Re-enters the deflate stream at the checkpoint's block boundary. `compressed_stream` is the
+    // same zlib stream the checkpoint was taken from and has to be seekable.
+    decompressed_stream_reader(
+      std::istream& compressed_stream, const decoder_checkpoint& checkpoint
+    ) :
+        compressed_stream_{compressed_stream} {
+      if (checkpoint.compressed_offset == 0) {
+        if (inflateInit(&z_stream_) != Z_OK) {
+          error_ = parse_error::inflate_init_failed;
+          eof_compressed_ = true;
+          return;
+        }
+      } else {
+        // raw inflate: the zlib header is behind us, and the trailer check needs the whole stream
+        if (inflateInit2(&z_stream_, -MAX_WBITS) != Z_OK) {
+          error_ = parse_error::inflate_init_failed;
+          eof_compressed_ = true;
+          return;
+        }
+      }
+      initialized_ = true;
+
+      std::uint64_t start = checkpoint.compressed_offset - (checkpoint.bits != 0 ? 1 : 0);
+      compressed_stream_.clear();
+      compressed_stream_.seekg(static_cast<std::streamoff>(start));
+      if (checkpoint.bits != 0) {
+        int byte = compressed_stream_.get();
+        if (byte == std::char_traits<char>::eof()) {
+          error_ = parse_error::inflate_failed;
+          eof_compressed_ = true;
+          return;
+        }
+        inflatePrime(&z_stream_, checkpoint.bits, byte >> (8 - checkpoint.bits));
+      }
+      if (checkpoint.compressed_offset != 0 && !checkpoint.window.empty()) {
+        inflateSetDictionary(
+          &z_stream_, reinterpret_cast<const Bytef*>(checkpoint.window.data()),
+          static_cast<uInt>(checkpoint.window.size())
+        );
+      }
+      if (!compressed_stream_) {
+        error_ = parse_error::inflate_failed;
+        eof_compressed_ = true;
+        return;
+      }
+
+      base_compressed_ = checkpoint.compressed_offset;
+      base_decompressed_ = checkpoint.boundary_offset;
+      boundary_ = {
+        checkpoint.compressed_offset, checkpoint.bits, checkpoint.boundary_offset,
+        checkpoint.window
+      };
+      buffer_.assign(checkpoint.pending.begin(), checkpoint.pending.end());
+      if (checkpoint.decompressed_offset >= checkpoint.boundary_offset) {
+        consumed_ = checkpoint.boundary_offset;
+        skip(static_cast<std::size_t>(checkpoint.decompressed_offset - consumed_));
+      } else {
+        consumed_ = checkpoint.decompressed_offset;
       }
     }
 
     ~decompressed_stream_reader() {
-      inflateEnd(&z_stream_);
+      if (initialized_) {
+        inflateEnd(&z_stream_);
+      }
     }
 
     decompressed_stream_reader(const decompressed_stream_reader&) = delete;
@@ -108,15 +405,78 @@ public:
     decompressed_stream_reader& operator=(decompressed_stream_reader&&) = delete;
 
     std::vector<std::byte> read(std::size_t size) {
+      std::vector<std::byte> result;
+      append_to(result, size);
+      return result;
+    }
+
+    // Appends up to `size` bytes to `out`, reusing its capacity.
+    std::size_t append_to(std::vector<std::byte>& out, std::size_t size) {
       fill_buffer(size);
       std::size_t bytes_to_read = std::min(size, buffer_.size());
-      std::vector<std::byte> result(buffer_.begin(), buffer_.begin() + bytes_to_read);
+      out.insert(out.end(), buffer_.begin(), buffer_.begin() + bytes_to_read);
       buffer_.erase(buffer_.begin(), buffer_.begin() + bytes_to_read);
-      return result;
+      consumed_ += bytes_to_read;
+      return bytes_to_read;
+    }
+
+    std::size_t read_into(std::span<std::byte> out) {
+      fill_buffer(out.size());
+      std::size_t bytes_to_read = std::min(out.size(), buffer_.size());
+      std::copy_n(buffer_.begin(), bytes_to_read, out.begin());
+      buffer_.erase(buffer_.begin(), buffer_.begin() + bytes_to_read);
+      consumed_ += bytes_to_read;
+      return bytes_to_read;
+    }
+
+    std::size_t skip(std::size_t size) {
+      std::size_t skipped = 0;
+      while (skipped < size) {
+        fill_buffer(std::min(size - skipped, CHUNK_SIZE));
+        std::size_t bytes_to_skip = std::min(size - skipped, buffer_.size());
+        if (bytes_to_skip == 0) {
+          break;
+        }
+        buffer_.erase(buffer_.begin(), buffer_.begin() + bytes_to_skip);
+        skipped += bytes_to_skip;
+      }
+      consumed_ += skipped;
+      return skipped;
     }
 
     void prepend_to_buffer(std::span<const std::byte> data) {
       buffer_.insert(buffer_.begin(), data.begin(), data.end());
+      consumed_ -= data.size();
+    }
+
+    std::uint64_t consumed() const {
+      return consumed_;
+    }
+
+    // compressed bytes inflated so far; exact even after the input stream hit EOF
+    std::uint64_t compressed_consumed() const {
+      return base_compressed_ + z_stream_.total_in;
+    }
+
+    // Records the deflate block boundaries passed from now on, which checkpoint() resumes from.
+    // Costs a copy of the 32 KiB window per block, so it is off by default.
+    void track_checkpoints() {
+      track_boundaries_ = true;
+    }
+
+    // Fills the inflate part of a checkpoint for the current read position. Requires
+    // track_checkpoints() to have been called before the first read.
+    void checkpoint(decoder_checkpoint& out) const {
+      out.compressed_offset = boundary_.compressed_offset;
+      out.bits = boundary_.bits;
+      out.boundary_offset = boundary_.decompressed_offset;
+      out.decompressed_offset = consumed_;
+      out.window = boundary_.window;
+      out.pending.clear();
+      if (boundary_.decompressed_offset > consumed_) {
+        std::size_t ahead = static_cast<std::size_t>(boundary_.decompressed_offset - consumed_);
+        out.pending.assign(buffer_.begin(), buffer_.begin() + ahead);
+      }
     }
 
     std::streampos tell() {
@@ -132,17 +492,67 @@ public:
       return eof_compressed_ && buffer_.empty();
     }
 
+    // Set once inflating failed; the bytes inflated before the failure can still be read.
+    std::error_code error() const {
+      return error_;
+    }
+
+    const char* inflate_message() const {
+      return z_stream_.msg ? z_stream_.msg : "unknown";
+    }
+
+    std::size_t compressed_bytes_fed() const {
+      return compressed_bytes_fed_;
+    }
+
+    // Set once inflate reached the zlib trailer and its checksum matched.
+    bool stream_complete() const {
+      return stream_complete_;
+    }
+
 private:
     static constexpr std::size_t CHUNK_SIZE = 16 * 1024;
     std::istream& compressed_stream_;
     z_stream z_stream_{};
     std::deque<std::byte> buffer_;
     bool eof_compressed_ = false;
+    bool stream_complete_ = false;
+    bool initialized_ = false;
+    std::error_code error_;
     std::size_t compressed_bytes_fed_ = 0;
+    std::uint64_t consumed_ = 0;
     std::vector<std::byte> input_chunk_buffer_{CHUNK_SIZE};
+    std::vector<std::byte> output_chunk_buffer_{CHUNK_SIZE};
+
+    struct block_boundary {
+      std::uint64_t compressed_offset = 0;
+      std::uint8_t bits = 0;
+      std::uint64_t decompressed_offset = 0;
+      std::vector<std::byte> window;
+    };
+
+    bool track_boundaries_ = false;
+    block_boundary boundary_;
+    // where a restored reader re-entered the stream; z_stream totals count from there
+    std::uint64_t base_compressed_ = 0;
+    std::uint64_t base_decompressed_ = 0;
+
+    void record_boundary() {
+      boundary_.compressed_offset = base_compressed_ + z_stream_.total_in;
+      boundary_.bits = static_cast<std::uint8_t>(z_stream_.data_type & 7);
+      boundary_.decompressed_offset = base_decompressed_ + z_stream_.total_out;
+      uInt window_size = 0;
+      inflateGetDictionary(&z_stream_, Z_NULL, &window_size);
+      boundary_.window.resize(window_size);
+      inflateGetDictionary(
+        &z_stream_, reinterpret_cast<Bytef*>(boundary_.window.data()), &window_size
+      );
+    }
 
     void fill_buffer(std::size_t min_bytes) {
+      memory_stage_scope stage(memory_stage::inflate);
       while (buffer_.size() < min_bytes && !eof_compressed_) {
+        trace_span span("inflate chunk");
         if (z_stream_.avail_in == 0 && !compressed_stream_.eof()) {
           compressed_stream_.read(reinterpret_cast<char*>(input_chunk_buffer_.data()), CHUNK_SIZE);
           std::streamsize bytes_read = compressed_stream_.gcount();
@@ -155,112 +565,96 @@ private:
           eof_compressed_ = true;
         }
 
-        std::vector<std::byte> output_chunk(CHUNK_SIZE);
         z_stream_.avail_out = CHUNK_SIZE;
-        z_stream_.next_out = reinterpret_cast<Bytef*>(output_chunk.data());
+        z_stream_.next_out = reinterpret_cast<Bytef*>(output_chunk_buffer_.data());
 
-        int ret = inflate(&z_stream_, eof_compressed_ ? Z_FINISH : Z_NO_FLUSH);
+        int flush = eof_compressed_ ? Z_FINISH : (track_boundaries_ ? Z_BLOCK : Z_NO_FLUSH);
+        int ret = inflate(&z_stream_, flush);
         if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
-          throw std::runtime_error(
-            std::format(
-              "zlib inflate error (fed ~{} bytes): {}", compressed_bytes_fed_,
-              z_stream_.msg ? z_stream_.msg : "unknown"
-            )
-          );
+          error_ = parse_error::inflate_failed;
+          eof_compressed_ = true;
+          return;
+        }
+        // bit 128: stopped right after a block, bit 64: that was the last one
+        if (track_boundaries_ && (z_stream_.data_type & 128) != 0 &&
+            (z_stream_.data_type & 64) == 0) {
+          record_boundary();
         }
 
         std::size_t have = CHUNK_SIZE - z_stream_.avail_out;
         if (have > 0) {
-          buffer_.insert(buffer_.end(), output_chunk.begin(), output_chunk.begin() + have);
+          buffer_.insert(
+            buffer_.end(), output_chunk_buffer_.begin(), output_chunk_buffer_.begin() + have
+          );
         }
 
         if (ret == Z_STREAM_END) {
           eof_compressed_ = true;
+          stream_complete_ = true;
         }
       }
     }
   };
 
-  struct variable_length_result {
+  export struct variable_length_result {
     std::int64_t payload_size;
     std::size_t prefix_bytes_read;
   };
 
-  std::optional<variable_length_result> read_variable_length_size(byte_stream_reader& stream) {
-    std::span<const std::byte> first_byte_data = stream.read(1);
-    if (first_byte_data.empty()) {
-      return std::nullopt;
-    }
-    std::uint8_t first_byte = static_cast<std::uint8_t>(first_byte_data[0]);
-    std::size_t prefix_bytes_read = 1;
-    std::int64_t payload_size = -1;
-
-    if ((first_byte & 0x80) != 0) {
-      if ((first_byte & 0x40) == 0) {
-        payload_size = first_byte & 0x7F;
-      } else {
-        std::println("Warning: Invalid first size prefix byte: {:#02x}", first_byte);
-        return variable_length_result{-1, prefix_bytes_read};
-      }
-    } else {
-      if ((first_byte & 0x40) != 0) {
-        std::span<const std::byte> b1_data = stream.read(1);
-        if (b1_data.size() < 1) {
-          return std::nullopt;
-        }
-        prefix_bytes_read += 1;
-        payload_size =
-          ((static_cast<std::uint32_t>(first_byte) << 8) | static_cast<std::uint8_t>(b1_data[0])) ^
-          0x4000;
-      } else if ((first_byte & 0x20) != 0) {
-        std::span<const std::byte> b1_b2_data = stream.read(2);
-        if (b1_b2_data.size() < 2) {
-          return std::nullopt;
-        }
-        prefix_bytes_read += 2;
-        payload_size = ((static_cast<std::uint32_t>(first_byte) << 16) |
-                        (static_cast<std::uint8_t>(b1_b2_data[0]) << 8) |
-                        static_cast<std::uint8_t>(b1_b2_data[1])) ^
-                       0x200000;
-      } else if ((first_byte & 0x10) != 0) {
-        std::span<const std::byte> b1_b3_data = stream.read(3);
-        if (b1_b3_data.size() < 3) {
-          return std::nullopt;
-        }
-        prefix_bytes_read += 3;
-        payload_size = ((static_cast<std::uint32_t>(first_byte) << 24) |
-                        (static_cast<std::uint8_t>(b1_b3_data[0]) << 16) |
-                        (static_cast<std::uint8_t>(b1_b3_data[1]) << 8) |
-                        static_cast<std::uint8_t>(b1_b3_data[2])) ^
-                       0x10000000;
+  // Prefix length by first byte, 0 for the invalid 0b11xxxxxx. The 1 to 4 byte forms are big
+  // endian with the length marker bit cleared; the 5 byte form is 0x00-0x0F and a little endian
+  // u32.
+  constexpr std::array<std::uint8_t, 256> size_prefix_lengths = [] {
+    std::array<std::uint8_t, 256> lengths{};
+    for (unsigned b = 0; b < 256; ++b) {
+      if ((b & 0xC0) == 0xC0) {
+        lengths[b] = 0;
+      } else if ((b & 0x80) != 0) {
+        lengths[b] = 1;
       } else {
-        std::span<const std::byte> b1_b4_data = stream.read(4);
-        if (b1_b4_data.size() < 4) {
-          return std::nullopt;
-        }
-        prefix_bytes_read += 4;
-        std::uint32_t raw_value;
-        std::memcpy(&raw_value, b1_b4_data.data(), sizeof(raw_value));
-        if constexpr (std::endian::native == std::endian::big) {
-          raw_value = std::byteswap(raw_value);
-        }
-        payload_size = raw_value;
+        int leading_zeros = std::countl_zero(static_cast<std::uint8_t>(b));
+        lengths[b] = static_cast<std::uint8_t>(std::min(leading_zeros, 4) + 1);
       }
     }
+    return lengths;
+  }();
 
-    if (payload_size < 0) {
-      std::println(
-        "Warning: Calculated negative payload size ({}). This might "
-        "indicate an issue.",
-        payload_size
-      );
-      return variable_length_result{-1, prefix_bytes_read};
+  constexpr std::array<std::uint32_t, 5> size_prefix_masks = {
+    0, 0x7F, 0x3FFF, 0x1FFFFF, 0x0FFFFFFF,
+  };
+
+  // Decodes the size prefix at the start of `bytes` with one table lookup and one 8 byte load.
+  // Returns nullopt if `bytes` ends inside the prefix and a negative size for an invalid prefix.
+  export std::optional<variable_length_result>
+  decode_size_prefix(std::span<const std::byte> bytes) {
+    if (bytes.empty()) {
+      return std::nullopt;
+    }
+    std::size_t length = size_prefix_lengths[static_cast<std::uint8_t>(bytes[0])];
+    if (length == 0) {
+      return variable_length_result{-1, 1};
+    }
+    if (bytes.size() < length) {
+      return std::nullopt;
     }
 
-    return variable_length_result{payload_size, prefix_bytes_read};
+    std::uint64_t raw = 0;
+    std::memcpy(&raw, bytes.data(), std::min<std::size_t>(bytes.size(), sizeof(raw)));
+    if constexpr (std::endian::native == std::endian::big) {
+      raw = std::byteswap(raw);
+    }
+    std::uint32_t size;
+    if (length == 5) {
+      size = static_cast<std::uint32_t>(raw >> 8);
+    } else {
+      std::uint64_t big_endian = std::byteswap(raw);
+      size = static_cast<std::uint32_t>(big_endian >> (64 - 8 * length)) &
+             size_prefix_masks[length];
+    }
+    return variable_length_result{size, length};
   }
 
-  struct packet_header_result {
+  export struct packet_header_result {
     std::uint8_t packet_type_val;
     std::uint32_t timestamp_ms;
     std::size_t bytes_read_for_header;
@@ -296,141 +690,715 @@ private:
     return packet_header_result{packet_type_val, timestamp_ms, bytes_read_for_header};
   }
 
-  export void process_stream(std::istream& compressed_stream) {
-    decompressed_stream_reader stream(compressed_stream);
-    int packet_index = 0;
-    std::uint32_t last_timestamp_ms = 0;
-    std::uint64_t total_decompressed_bytes_processed = 0;
 
-    while (!stream.is_eof()) {
-      std::streampos approx_compressed_pos_start_packet = stream.tell();
-      std::println(
-        "\n== Packet {} (Comp. offset ~{:#0x}) ==", packet_index,
-        static_cast<std::uint64_t>(approx_compressed_pos_start_packet)
-      );
-      try {
-        std::vector<std::byte> size_prefix_bytes = stream.read(5);
-        if (size_prefix_bytes.empty()) {
-          if (stream.is_eof()) {
-            std::println("Clean EOF reached before next packet size prefix.");
-          } else {
-            std::println("Could not read packet size prefix despite not being at EOF.");
-          }
-          break;
-        }
+  // A framed packet whose bytes belong to the framer; valid until the framer advances.
+  export struct packet_view {
+    std::uint32_t index = 0;
+    // Approximate: inflate output does not map to whole input bytes, so this is how far the
+    // compressed input had been consumed by the inflate call that produced the packet's first byte.
+    std::uint64_t compressed_offset = 0;
+    std::uint64_t decompressed_offset = 0;
+    std::size_t prefix_bytes_read = 0;
+    std::int64_t expected_size = 0;
+    std::optional<packet_header_result> header;
+    std::span<const std::byte> data;
 
-        byte_stream_reader prefix_stream(size_prefix_bytes);
-        std::optional<variable_length_result> size_result =
-          read_variable_length_size(prefix_stream);
+    std::span<const std::byte> payload() const {
+      if (!header) {
+        return {};
+      }
+      return data.subspan(header->bytes_read_for_header);
+    }
+  };
 
-        if (!size_result || size_result->payload_size < 0) {
-          std::print("Error reading/interpreting size prefix. Bytes: ");
-          for (const std::byte b : size_prefix_bytes) {
-            std::print("{:02x}", static_cast<std::uint8_t>(b));
+  // Filter evaluated by packet_framer before a packet's payload is copied out of the inflate
+  // buffer. Message and object ids only constrain MPI packets; setting either without a type list
+  // restricts the output to MPI.
+  export struct packet_filter {
+    std::bitset<256> types;
+    std::bitset<65536> message_ids;
+    std::bitset<65536> object_ids;
+    bool filter_types = false;
+    bool filter_messages = false;
+    bool filter_objects = false;
+    std::uint32_t min_timestamp_ms = 0;
+    std::uint32_t max_timestamp_ms = std::numeric_limits<std::uint32_t>::max();
+
+    bool empty() const {
+      return !filter_types && !filter_messages && !filter_objects && min_timestamp_ms == 0 &&
+             max_timestamp_ms == std::numeric_limits<std::uint32_t>::max();
+    }
+
+    bool needs_mpi_header() const {
+      return filter_messages || filter_objects;
+    }
+
+    bool accepts_header(std::uint8_t type_val, std::uint32_t timestamp_ms) const {
+      if (timestamp_ms < min_timestamp_ms || timestamp_ms > max_timestamp_ms) {
+        return false;
+      }
+      if (filter_types) {
+        return types.test(type_val);
+      }
+      return !needs_mpi_header() || static_cast<packet_type>(type_val) == packet_type::mpi;
+    }
+
+    bool accepts_mpi(const mpi_message& header) const {
+      return (!filter_messages || message_ids.test(header.message_id)) &&
+             (!filter_objects || object_ids.test(header.object_id));
+    }
+
+    // Applies the whole filter to a packet that was already framed.
+    bool accepts(const packet_view& packet) const {
+      if (!packet.header) {
+        return empty();
+      }
+      if (!accepts_header(packet.header->packet_type_val, packet.header->timestamp_ms)) {
+        return false;
+      }
+      if (static_cast<packet_type>(packet.header->packet_type_val) != packet_type::mpi ||
+          !needs_mpi_header()) {
+        return true;
+      }
+      std::optional<mpi_message> mpi = read_mpi_message(packet.payload());
+      return mpi && accepts_mpi(*mpi);
+    }
+  };
+
+  template <typename T>
+  std::optional<T> parse_filter_number(std::string_view text) {
+    int base = 10;
+    if (text.starts_with("0x") || text.starts_with("0X")) {
+      text.remove_prefix(2);
+      base = 16;
+    }
+    T value{};
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+    if (ec != std::errc{} || ptr != text.data() + text.size()) {
+      return std::nullopt;
+    }
+    return value;
+  }
+
+  std::optional<std::uint8_t> parse_filter_packet_type(std::string_view text) {
+    for (unsigned type_val = 0; type_val <= static_cast<unsigned>(packet_type::replay_header_info);
+         ++type_val) {
+      if (get_packet_type_name(static_cast<std::uint8_t>(type_val)) == text) {
+        return static_cast<std::uint8_t>(type_val);
+      }
+    }
+    return parse_filter_number<std::uint8_t>(text);
+  }
+
+  std::optional<std::uint16_t> parse_filter_message_id(std::string_view text) {
+    if (std::optional<std::uint16_t> id = packet_ids::find_id(text)) {
+      return id;
+    }
+    return parse_filter_number<std::uint16_t>(text);
+  }
+
+  // Parses whitespace separated terms such as `type=chat,mpi msg=0xF058 obj=0x01A3 t=1000-5000`.
+  // Values within a term are comma separated; `t` takes an inclusive millisecond range. Message
+  // ids may also be given by catalog name, e.g. `msg=TextKillReport`.
+  export std::optional<packet_filter> parse_packet_filter(std::string_view expression) {
+    packet_filter filter;
+
+    auto next_token = [](std::string_view& text, char delimiter) {
+      std::size_t end = text.find(delimiter);
+      std::string_view token = text.substr(0, end);
+      text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+      return token;
+    };
+
+    while (!expression.empty()) {
+      std::string_view term = next_token(expression, ' ');
+      if (term.empty()) {
+        continue;
+      }
+      std::size_t eq = term.find('=');
+      if (eq == std::string_view::npos) {
+        return std::nullopt;
+      }
+      std::string_view key = term.substr(0, eq);
+      std::string_view values = term.substr(eq + 1);
+
+      if (key == "t") {
+        std::size_t dash = values.find('-');
+        if (dash == std::string_view::npos) {
+          return std::nullopt;
+        }
+        auto min_ms = parse_filter_number<std::uint32_t>(values.substr(0, dash));
+        auto max_ms = parse_filter_number<std::uint32_t>(values.substr(dash + 1));
+        if (!min_ms || !max_ms || *min_ms > *max_ms) {
+          return std::nullopt;
+        }
+        filter.min_timestamp_ms = *min_ms;
+        filter.max_timestamp_ms = *max_ms;
+        continue;
+      }
+
+      while (!values.empty()) {
+        std::string_view value = next_token(values, ',');
+        if (key == "type") {
+          std::optional<std::uint8_t> type_val = parse_filter_packet_type(value);
+          if (!type_val) {
+            return std::nullopt;
           }
-          std::println(". Stopping.");
-          break;
+          filter.types.set(*type_val);
+          filter.filter_types = true;
+        } else if (key == "msg") {
+          std::optional<std::uint16_t> message_id = parse_filter_message_id(value);
+          if (!message_id) {
+            return std::nullopt;
+          }
+          filter.message_ids.set(*message_id);
+          filter.filter_messages = true;
+        } else if (key == "obj") {
+          std::optional<std::uint16_t> object_id = parse_filter_number<std::uint16_t>(value);
+          if (!object_id) {
+            return std::nullopt;
+          }
+          filter.object_ids.set(*object_id);
+          filter.filter_objects = true;
+        } else {
+          return std::nullopt;
         }
+      }
+    }
+    return filter;
+  }
 
-        std::span<const std::byte> unused_prefix_bytes = prefix_stream.remaining_bytes();
-        stream.prepend_to_buffer(unused_prefix_bytes);
+  export struct framed_packet {
+    std::uint32_t index = 0;
+    std::uint64_t compressed_offset = 0;
+    std::uint64_t decompressed_offset = 0;
+    std::size_t prefix_bytes_read = 0;
+    std::int64_t expected_size = 0;
+    std::optional<packet_header_result> header;
+    std::vector<std::byte> data;
 
-        std::int64_t payload_size = size_result->payload_size;
-        std::size_t prefix_bytes_read = size_result->prefix_bytes_read;
+    framed_packet() = default;
 
-        std::println(
-          "  Read size prefix ({} decomp. bytes): Expected payload "
-          "size = {} bytes",
-          prefix_bytes_read, payload_size
-        );
+    explicit framed_packet(const packet_view& view) :
+        index{view.index}, compressed_offset{view.compressed_offset},
+        decompressed_offset{view.decompressed_offset}, prefix_bytes_read{view.prefix_bytes_read},
+        expected_size{view.expected_size}, header{view.header},
+        data(view.data.begin(), view.data.end()) {
+    }
 
-        std::vector<std::byte> packet_data = stream.read(payload_size);
+    packet_view view() const {
+      return {
+        index,         compressed_offset, decompressed_offset, prefix_bytes_read,
+        expected_size, header,            data,
+      };
+    }
 
-        if (packet_data.size() != static_cast<std::size_t>(payload_size)) {
-          std::println(
-            "  Warning: Incomplete packet! Expected {}, got {}.", payload_size, packet_data.size()
-          );
-          if (packet_data.empty()) {
-            std::println("  No payload data read. Stopping.");
-            break;
+    std::span<const std::byte> payload() const {
+      return view().payload();
+    }
+  };
+
+  export class packet_framer {
+public:
+    explicit packet_framer(std::istream& compressed_stream, const packet_filter& filter = {}) :
+        stream_{compressed_stream}, filter_{filter} {
+    }
+
+    // Continues framing where checkpoint() left off; the result is the same as if this framer had
+    // read the whole stream. Checkpoint tracking stays on.
+    packet_framer(
+      std::istream& compressed_stream, const decoder_checkpoint& checkpoint,
+      const packet_filter& filter = {}
+    ) :
+        stream_{compressed_stream, checkpoint}, filter_{filter},
+        next_index_{checkpoint.packet_index}, last_timestamp_ms_{checkpoint.last_timestamp_ms} {
+      stream_.track_checkpoints();
+    }
+
+    // Must be called before the first packet is read for checkpoint() to be usable.
+    void track_checkpoints() {
+      stream_.track_checkpoints();
+    }
+
+    // State to resume from, positioned right after the last packet returned.
+    decoder_checkpoint checkpoint() const {
+      decoder_checkpoint result;
+      stream_.checkpoint(result);
+      result.packet_index = next_index_;
+      result.last_timestamp_ms = last_timestamp_ms_;
+      return result;
+    }
+
+    // An empty optional marks the clean end of the stream; inflate and framing failures are
+    // returned as parse_error codes.
+    std::expected<std::optional<framed_packet>, std::error_code> next() {
+      memory_stage_scope stage(memory_stage::framing);
+      auto view = next_view();
+      if (!view) {
+        return std::unexpected(view.error());
+      }
+      if (!*view) {
+        return std::nullopt;
+      }
+      return framed_packet(**view);
+    }
+
+    // Like next(), but the packet bytes stay in a buffer the framer reuses for every packet, so
+    // framing does not allocate once the buffer has grown to the largest packet.
+    std::expected<std::optional<packet_view>, std::error_code> next_view() {
+      memory_stage_scope stage(memory_stage::framing);
+      while (true) {
+        if (stream_.is_eof()) {
+          if (stream_.error()) {
+            return std::unexpected(stream_.error());
           }
+          return std::nullopt;
         }
-        total_decompressed_bytes_processed += packet_data.size();
-        byte_stream_reader payload_stream(packet_data);
-        std::optional<packet_header_result> header_result =
-          read_packet_header_from_stream(payload_stream, last_timestamp_ms);
-        if (header_result) {
-          std::println(
-            "  Parsed Header ({} bytes): Type={}, Timestamp={}ms",
-            header_result->bytes_read_for_header,
-            get_packet_type_name(header_result->packet_type_val), header_result->timestamp_ms
-          );
-          last_timestamp_ms = header_result->timestamp_ms;
-          std::span<const std::byte> payload_bytes = payload_stream.remaining_bytes();
-          std::size_t payload_size_actual = payload_bytes.size();
-          std::println("  Actual Payload Size: {} bytes", payload_size_actual);
-
-          if (static_cast<packet_type>(header_result->packet_type_val) == packet_type::chat) {
-            auto chat_result = deserialize_chat(payload_bytes);
-            if (chat_result) {
-              std::println(
-                "  Chat Sender='{}', Message='{}', IsEnemy={}, Channel={}, UnreadBits={}",
-                chat_result->sender_name, chat_result->message,
-                chat_result->is_enemy ? "true" : "false", chat_result->channel_id,
-                (payload_bytes.size() * 8) - chat_result->bits_read
-              );
-            } else {
-              std::println(
-                "  Failed to deserialize chat packet: {}", chat_result.error().message()
-              );
-            }
+
+        packet_view packet;
+        packet.index = next_index_;
+        packet.compressed_offset = static_cast<std::uint64_t>(stream_.tell());
+        packet.decompressed_offset = stream_.consumed();
+
+        std::array<std::byte, 5> size_prefix_bytes;
+        std::size_t size_prefix_size = stream_.read_into(size_prefix_bytes);
+        if (size_prefix_size == 0) {
+          if (stream_.error()) {
+            return std::unexpected(stream_.error());
           }
-          if (static_cast<packet_type>(header_result->packet_type_val) == packet_type::mpi) {
-            if (payload_size_actual >= 5) {
-              std::uint16_t obj_id, msg_id;
-              std::uint8_t skipped_byte;
-              std::memcpy(&obj_id, payload_bytes.data(), sizeof(obj_id));
-              std::memcpy(&skipped_byte, payload_bytes.data() + 2, sizeof(skipped_byte));
-              std::memcpy(&msg_id, payload_bytes.data() + 3, sizeof(msg_id));
-              if constexpr (std::endian::native == std::endian::big) {
-                obj_id = std::byteswap(obj_id);
-                msg_id = std::byteswap(msg_id);
-              }
-              std::println(
-                "  MPI Header:      ObjectID=0x{:04X}, MessageID=0x{:04X} ({})", obj_id, msg_id,
-                packet_ids::get_name(msg_id).value_or("Unknown")
-              );
-
-              payload_bytes = payload_bytes.subspan(5);
-              payload_size_actual -= 5;
-            }
+          if (stream_.is_eof()) {
+            return std::nullopt;
           }
-          if (payload_size_actual > 0) {
-            std::print("  Payload Hex: ");
-            std::size_t bytes_to_print =
-              std::min(payload_size_actual, static_cast<std::size_t>(64));
-            for (std::size_t i = 0; i < bytes_to_print; ++i) {
-              std::print("{:02X} ", static_cast<std::uint8_t>(payload_bytes[i]));
-            }
-            if (payload_size_actual > bytes_to_print) {
-              std::print("...");
-            }
-            std::println("");
-          } else {
-            std::println("  Payload Hex: (empty)");
+          return std::unexpected(make_error_code(parse_error::truncated_prefix));
+        }
+
+        std::span<const std::byte> prefix = std::span(size_prefix_bytes).first(size_prefix_size);
+        std::optional<variable_length_result> size_result = decode_size_prefix(prefix);
+        if (!size_result || size_result->payload_size < 0) {
+          invalid_prefix_.assign(prefix.begin(), prefix.end());
+          return std::unexpected(make_error_code(parse_error::invalid_prefix));
+        }
+        stream_.prepend_to_buffer(prefix.subspan(size_result->prefix_bytes_read));
+
+        packet.prefix_bytes_read = size_result->prefix_bytes_read;
+        packet.expected_size = size_result->payload_size;
+        std::size_t packet_size = static_cast<std::size_t>(packet.expected_size);
+
+        packet_buffer_.clear();
+        if (filter_.empty()) {
+          stream_.append_to(packet_buffer_, packet_size);
+        } else {
+          // only the packet header and the MPI header are copied out before the filter decides
+          stream_.append_to(packet_buffer_, std::min(packet_size, filter_peek_size));
+          if (!packet_buffer_.empty() && !accepts(packet_buffer_)) {
+            stream_.skip(packet_size - packet_buffer_.size());
+            skipped_packets_++;
+            next_index_++;
+            continue;
           }
+          stream_.append_to(packet_buffer_, packet_size - packet_buffer_.size());
+        }
+        if (packet_buffer_.empty() && packet.expected_size != 0) {
+          if (stream_.error()) {
+            return std::unexpected(stream_.error());
+          }
+          return std::unexpected(make_error_code(parse_error::empty_payload));
+        }
+        packet.data = packet_buffer_;
+
+        byte_stream_reader payload_stream(packet.data);
+        packet.header = read_packet_header_from_stream(payload_stream, last_timestamp_ms_);
+        if (packet.header) {
+          last_timestamp_ms_ = packet.header->timestamp_ms;
+        }
+
+        next_index_++;
+        return packet;
+      }
+    }
+
+    // Discards decompressed bytes up to `decompressed_offset` without framing them, so packets
+    // located through an index can be read directly. `timestamp_ms` restores the running timestamp
+    // that packets with a short header inherit.
+    bool seek(
+      std::uint64_t decompressed_offset, std::uint32_t packet_index, std::uint32_t timestamp_ms
+    ) {
+      std::uint64_t position = stream_.consumed();
+      if (decompressed_offset < position) {
+        return false;
+      }
+      std::uint64_t distance = decompressed_offset - position;
+      if (stream_.skip(static_cast<std::size_t>(distance)) != distance) {
+        return false;
+      }
+      next_index_ = packet_index;
+      last_timestamp_ms_ = timestamp_ms;
+      return true;
+    }
+
+    std::span<const std::byte> invalid_prefix() const {
+      return invalid_prefix_;
+    }
+
+    const packet_filter& filter() const {
+      return filter_;
+    }
+
+    std::streampos tell() {
+      return stream_.tell();
+    }
+
+    std::uint64_t skipped_packets() const {
+      return skipped_packets_;
+    }
+
+    std::uint64_t compressed_consumed() const {
+      return stream_.compressed_consumed();
+    }
+
+    const char* inflate_message() const {
+      return stream_.inflate_message();
+    }
+
+    std::size_t compressed_bytes_fed() const {
+      return stream_.compressed_bytes_fed();
+    }
+
+    // Whether the stream was inflated up to its trailer, as opposed to running out of input.
+    bool stream_complete() const {
+      return stream_.stream_complete();
+    }
+
+private:
+    // largest packet header (type + timestamp) followed by the MPI header
+    static constexpr std::size_t filter_peek_size = 5 + mpi_header_size;
+
+    decompressed_stream_reader stream_;
+    packet_filter filter_;
+    std::vector<std::byte> packet_buffer_;
+    std::uint64_t skipped_packets_ = 0;
+    std::uint32_t next_index_ = 0;
+    std::uint32_t last_timestamp_ms_ = 0;
+    std::vector<std::byte> invalid_prefix_;
+
+    bool accepts(std::span<const std::byte> head) {
+      byte_stream_reader head_stream(head);
+      std::optional<packet_header_result> header =
+        read_packet_header_from_stream(head_stream, last_timestamp_ms_);
+      if (!header) {
+        return false;
+      }
+      last_timestamp_ms_ = header->timestamp_ms;
+
+      if (!filter_.accepts_header(header->packet_type_val, header->timestamp_ms)) {
+        return false;
+      }
+      if (static_cast<packet_type>(header->packet_type_val) != packet_type::mpi ||
+          !filter_.needs_mpi_header()) {
+        return true;
+      }
+      std::optional<mpi_message> mpi = read_mpi_message(head_stream.remaining_bytes());
+      return mpi && filter_.accepts_mpi(*mpi);
+    }
+  };
+
+  // Push-driven counterpart of packet_framer for callers that receive the compressed stream in
+  // chunks and cannot block on an istream, such as a browser download. Only the inflated bytes of
+  // packets that are not complete yet are kept between pushes.
+  export class incremental_framer {
+public:
+    incremental_framer() {
+      if (inflateInit(&z_stream_) != Z_OK) {
+        error_ = parse_error::inflate_init_failed;
+        return;
+      }
+      initialized_ = true;
+    }
+
+    ~incremental_framer() {
+      if (initialized_) {
+        inflateEnd(&z_stream_);
+      }
+    }
+
+    incremental_framer(const incremental_framer&) = delete;
+    incremental_framer& operator=(const incremental_framer&) = delete;
+
+    // Inflates `compressed` into the pending buffer. Frame the result with next_view() before
+    // pushing again to keep the buffer small.
+    std::error_code push(std::span<const std::byte> compressed) {
+      memory_stage_scope stage(memory_stage::inflate);
+      trace_span span("inflate push");
+      if (error_ || stream_end_) {
+        return error_;
+      }
+      z_stream_.next_in = reinterpret_cast<Bytef*>(const_cast<std::byte*>(compressed.data()));
+      z_stream_.avail_in = static_cast<uInt>(compressed.size());
+      // a full output chunk may leave inflated bytes inside zlib, so keep going until it is not
+      do {
+        z_stream_.next_out = reinterpret_cast<Bytef*>(output_chunk_buffer_.data());
+        z_stream_.avail_out = CHUNK_SIZE;
+        int ret = inflate(&z_stream_, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+          error_ = parse_error::inflate_failed;
+          break;
+        }
+        std::size_t have = CHUNK_SIZE - z_stream_.avail_out;
+        pending_.insert(
+          pending_.end(), output_chunk_buffer_.begin(), output_chunk_buffer_.begin() + have
+        );
+        if (have > 0) {
+          inflate_marks_.emplace_back(z_stream_.total_out, z_stream_.total_in);
         }
-      } catch (const std::exception& e) {
-        std::println(stderr, "  Error during packet processing loop: {}", e.what());
+        stream_end_ = ret == Z_STREAM_END;
+      } while (z_stream_.avail_out == 0 && !stream_end_);
+      return error_;
+    }
+
+    // Appends bytes that were already inflated elsewhere, e.g. on another thread. Use either this
+    // or push() for one stream, not both.
+    void push_inflated(std::span<const std::byte> decompressed) {
+      memory_stage_scope stage(memory_stage::framing);
+      pending_.insert(pending_.end(), decompressed.begin(), decompressed.end());
+    }
+
+    // Marks the end of the input; a packet cut short by it is still handed out, as packet_framer
+    // does at the end of a stream.
+    void finish() {
+      finished_ = true;
+    }
+
+    // Frames the next packet from the bytes pushed so far. An empty optional means more input is
+    // needed, or that everything was framed once finish() was called.
+    std::expected<std::optional<packet_view>, std::error_code> next_view() {
+      memory_stage_scope stage(memory_stage::framing);
+      compact();
+      std::span<const std::byte> available = std::span(pending_).subspan(read_offset_);
+      if (available.empty()) {
+        if (error_) {
+          return std::unexpected(error_);
+        }
+        return std::nullopt;
+      }
+
+      std::optional<variable_length_result> size_result = decode_size_prefix(available);
+      if (!size_result) {
+        if (!finished_) {
+          return std::nullopt;
+        }
+        return std::unexpected(make_error_code(parse_error::truncated_prefix));
+      }
+      if (size_result->payload_size < 0) {
+        return std::unexpected(make_error_code(parse_error::invalid_prefix));
+      }
+
+      std::size_t packet_size = static_cast<std::size_t>(size_result->payload_size);
+      std::span<const std::byte> body = available.subspan(size_result->prefix_bytes_read);
+      if (body.size() < packet_size && !finished_ && !error_) {
+        return std::nullopt;
+      }
+      body = body.first(std::min(body.size(), packet_size));
+      if (body.empty() && packet_size != 0) {
+        return std::unexpected(make_error_code(parse_error::empty_payload));
+      }
+
+      packet_view packet;
+      packet.index = next_index_++;
+      while (!inflate_marks_.empty() && inflate_marks_.front().first <= consumed_) {
+        inflate_marks_.pop_front();
+      }
+      packet.compressed_offset =
+        inflate_marks_.empty() ? z_stream_.total_in : inflate_marks_.front().second;
+      packet.decompressed_offset = consumed_;
+      packet.prefix_bytes_read = size_result->prefix_bytes_read;
+      packet.expected_size = size_result->payload_size;
+      packet.data = body;
+
+      byte_stream_reader payload_stream(packet.data);
+      packet.header = read_packet_header_from_stream(payload_stream, last_timestamp_ms_);
+      if (packet.header) {
+        last_timestamp_ms_ = packet.header->timestamp_ms;
+      }
+
+      std::size_t framed = size_result->prefix_bytes_read + body.size();
+      read_offset_ += framed;
+      consumed_ += framed;
+      return packet;
+    }
+
+    // true once the deflate stream ended and every inflated byte was framed
+    bool done() const {
+      return stream_end_ && read_offset_ == pending_.size();
+    }
+
+    std::size_t buffered_bytes() const {
+      return pending_.size() - read_offset_;
+    }
+
+    std::error_code error() const {
+      return error_;
+    }
+
+private:
+    static constexpr std::size_t CHUNK_SIZE = 16 * 1024;
+    z_stream z_stream_{};
+    bool initialized_ = false;
+    bool stream_end_ = false;
+    bool finished_ = false;
+    std::error_code error_;
+    std::vector<std::byte> output_chunk_buffer_{CHUNK_SIZE};
+    std::vector<std::byte> pending_;
+    std::size_t read_offset_ = 0;
+    std::uint64_t consumed_ = 0;
+    std::uint32_t next_index_ = 0;
+    std::uint32_t last_timestamp_ms_ = 0;
+    // (inflated total, compressed total) after each inflate call that produced output; only the
+    // calls past the framing position are kept
+    std::deque<std::pair<std::uint64_t, std::uint64_t>> inflate_marks_;
+
+    // drops framed bytes once they make up most of the buffer, so moves stay amortized
+    void compact() {
+      if (read_offset_ > 0 && read_offset_ * 2 >= pending_.size()) {
+        pending_.erase(pending_.begin(), pending_.begin() + read_offset_);
+        read_offset_ = 0;
+      }
+    }
+  };
+
+  std::string type_label(std::uint8_t type_val) {
+    if (std::optional<std::string_view> name = get_packet_type_name(type_val)) {
+      return std::string(*name);
+    }
+    return std::format("unknown ({})", type_val);
+  }
+
+  export void print_packet(const packet_view& packet) {
+    memory_stage_scope stage(memory_stage::output);
+    trace_span span("print packet");
+    std::println(
+      "\n== Packet {} (Comp. offset ~{:#0x}) ==", packet.index, packet.compressed_offset
+    );
+    std::println(
+      "  Read size prefix ({} decomp. bytes): Expected payload "
+      "size = {} bytes",
+      packet.prefix_bytes_read, packet.expected_size
+    );
+
+    if (packet.data.size() != static_cast<std::size_t>(packet.expected_size)) {
+      std::println(
+        "  Warning: Incomplete packet! Expected {}, got {}.", packet.expected_size,
+        packet.data.size()
+      );
+    }
+    if (!packet.header) {
+      return;
+    }
+
+    std::println(
+      "  Parsed Header ({} bytes): Type={}, Timestamp={}ms", packet.header->bytes_read_for_header,
+      type_label(packet.header->packet_type_val), packet.header->timestamp_ms
+    );
+    std::span<const std::byte> payload_bytes = packet.payload();
+    std::size_t payload_size_actual = payload_bytes.size();
+    std::println("  Actual Payload Size: {} bytes", payload_size_actual);
+
+    if (static_cast<packet_type>(packet.header->packet_type_val) == packet_type::chat) {
+      auto chat_result = deserialize_chat(payload_bytes);
+      if (chat_result) {
+        std::println(
+          "  Chat Sender='{}', Message='{}', IsEnemy={}, Channel={}, UnreadBits={}",
+          chat_result->sender_name, chat_result->message, chat_result->is_enemy ? "true" : "false",
+          chat_result->channel_id, (payload_bytes.size() * 8) - chat_result->bits_read
+        );
+      } else {
+        std::println("  Failed to deserialize chat packet: {}", chat_result.error().message());
+      }
+    }
+    if (static_cast<packet_type>(packet.header->packet_type_val) == packet_type::mpi) {
+      if (std::optional<mpi_message> mpi = read_mpi_message(payload_bytes)) {
+        std::println(
+          "  MPI Header:      ObjectID=0x{:04X}, Reserved=0x{:02X}, MessageID=0x{:04X} ({})",
+          mpi->object_id, mpi->reserved, mpi->message_id,
+          packet_ids::get_name(mpi->message_id).value_or("Unknown")
+        );
+
+        payload_bytes = mpi->body;
+        payload_size_actual = payload_bytes.size();
+      }
+    }
+    if (payload_size_actual > 0) {
+      std::print("  Payload Hex: ");
+      std::size_t bytes_to_print = std::min(payload_size_actual, static_cast<std::size_t>(64));
+      for (std::size_t i = 0; i < bytes_to_print; ++i) {
+        std::print("{:02X} ", static_cast<std::uint8_t>(payload_bytes[i]));
+      }
+      if (payload_size_actual > bytes_to_print) {
+        std::print("...");
+      }
+      std::println("");
+    } else {
+      std::println("  Payload Hex: (empty)");
+    }
+  }
+
+  export void print_packet(const framed_packet& packet) {
+    print_packet(packet.view());
+  }
+
+  // Prints up to `max_packets` packets from `framer`, which may have been restored from a
+  // checkpoint. Returns false once the stream has ended or failed.
+  export bool process_stream(
+    packet_framer& framer,
+    std::uint64_t max_packets = std::numeric_limits<std::uint64_t>::max()
+  ) {
+    std::uint64_t total_decompressed_bytes_processed = 0;
+
+    std::error_code error;
+    bool more = true;
+    for (std::uint64_t printed = 0; printed < max_packets; ++printed) {
+      auto packet = framer.next_view();
+      if (!packet) {
+        error = packet.error();
+        more = false;
         break;
       }
-      packet_index++;
+      if (!*packet) {
+        more = false;
+        break;
+      }
+      total_decompressed_bytes_processed += (*packet)->data.size();
+      print_packet(**packet);
     }
-    std::streampos approx_compressed_pos_end = stream.tell();
+
+    if (error == parse_error::invalid_prefix) {
+      std::print("Error reading/interpreting size prefix. Bytes: ");
+      for (const std::byte b : framer.invalid_prefix()) {
+        std::print("{:02x}", static_cast<std::uint8_t>(b));
+      }
+      std::println(". Stopping.");
+    } else if (error == parse_error::inflate_failed) {
+      std::println(
+        stderr, "  Error during packet processing loop: zlib inflate error (fed ~{} bytes): {}",
+        framer.compressed_bytes_fed(), framer.inflate_message()
+      );
+    } else if (error) {
+      std::println("{}. Stopping.", error.message());
+    }
+
+    std::streampos approx_compressed_pos_end = framer.tell();
     std::println(
       "\n== End of stream processing (Comp. offset ~{:#0x}) ==",
       static_cast<std::uint64_t>(approx_compressed_pos_end)
     );
     std::println("Total decompressed bytes processed: {}", total_decompressed_bytes_processed);
+    if (!framer.filter().empty()) {
+      std::println("Packets skipped by filter: {}", framer.skipped_packets());
+    }
+    return more;
+  }
+
+  export void process_stream(std::istream& compressed_stream, const packet_filter& filter = {}) {
+    packet_framer framer(compressed_stream, filter);
+    process_stream(framer);
   }
 } // namespace wrpl
@@ -0,0 +1,434 @@
+module;
+
+#include <print>
+
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <expected>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define WRPL_HAS_UNIX_SOCKETS 1
+#endif
+
+export module serve;
+
+import deserializer;
+import header;
+import json;
+import object_index;
+import parser;
+import stream_scan;
+
+namespace wrpl {
+
+  // A replay kept in memory by the daemon: every packet framed once, plus the object index so
+  // object queries do not scan the whole table.
+  struct loaded_replay {
+    std::filesystem::file_time_type modified;
+    std::vector<framed_packet> packets;
+    object_index objects;
+    std::size_t memory_bytes = 0;
+    // why framing stopped before the end of the stream; the packets before it are served
+    std::optional<std::string> error;
+  };
+
+  std::expected<loaded_replay, std::string> load_replay(const std::filesystem::path& path) {
+    std::error_code ec;
+    loaded_replay replay;
+    replay.modified = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+      return std::unexpected(std::format("cannot stat {}: {}", path.string(), ec.message()));
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> content{std::istreambuf_iterator<char>(file), {}};
+    std::span<const std::byte> bytes = std::as_bytes(std::span(content));
+    std::vector<std::size_t> offsets = find_zlib_streams(bytes, replay_header_size, 1);
+    if (offsets.empty()) {
+      return std::unexpected(std::format("zlib stream not found in {}", path.string()));
+    }
+
+    memory_istream stream(bytes.subspan(offsets.front()));
+    packet_framer framer(stream);
+    auto packet = framer.next();
+    for (; packet && *packet; packet = framer.next()) {
+      framed_packet& framed = **packet;
+      if (framed.header &&
+          static_cast<packet_type>(framed.header->packet_type_val) == packet_type::mpi) {
+        if (std::optional<mpi_message> mpi = read_mpi_message(framed.payload())) {
+          replay.objects.add(
+            mpi->object_id,
+            {framed.index, framed.decompressed_offset, framed.header->timestamp_ms}
+          );
+        }
+      }
+      replay.memory_bytes += sizeof(framed_packet) + framed.data.capacity();
+      replay.packets.push_back(std::move(framed));
+    }
+    if (!packet) {
+      replay.error = packet.error().message();
+    }
+    replay.memory_bytes += replay.objects.memory_bytes();
+    return replay;
+  }
+
+  // Least recently used replays are dropped once the loaded ones exceed `budget_bytes`. Entries
+  // are shared, so a replay evicted while a query still streams it stays alive until it is done.
+  class replay_cache {
+public:
+    explicit replay_cache(std::size_t budget_bytes) : budget_bytes_{budget_bytes} {
+    }
+
+    std::expected<std::shared_ptr<const loaded_replay>, std::string>
+    get(const std::string& path) {
+      std::error_code ec;
+      std::filesystem::file_time_type modified = std::filesystem::last_write_time(path, ec);
+      {
+        std::lock_guard lock(mutex_);
+        auto it = entries_.find(path);
+        if (it != entries_.end() && !ec && it->second.replay->modified == modified) {
+          order_.splice(order_.begin(), order_, it->second.position);
+          hits_++;
+          return it->second.replay;
+        }
+      }
+
+      // loaded without the lock so other clients are not blocked behind a cold replay
+      std::expected<loaded_replay, std::string> loaded = load_replay(path);
+      if (!loaded) {
+        return std::unexpected(std::move(loaded.error()));
+      }
+      auto replay = std::make_shared<const loaded_replay>(std::move(*loaded));
+
+      std::lock_guard lock(mutex_);
+      misses_++;
+      erase(path);
+      order_.push_front(path);
+      entries_[path] = {replay, order_.begin()};
+      used_bytes_ += replay->memory_bytes;
+      while (used_bytes_ > budget_bytes_ && order_.size() > 1) {
+        erase(order_.back());
+      }
+      return replay;
+    }
+
+    bool evict(const std::string& path) {
+      std::lock_guard lock(mutex_);
+      return erase(path);
+    }
+
+    void print_stats(std::FILE* out) {
+      std::lock_guard lock(mutex_);
+      std::println(
+        out,
+        R"({{"replays":{},"used_bytes":{},"budget_bytes":{},"hits":{},"misses":{}}})",
+        entries_.size(), used_bytes_, budget_bytes_, hits_, misses_
+      );
+    }
+
+private:
+    struct entry {
+      std::shared_ptr<const loaded_replay> replay;
+      std::list<std::string>::iterator position;
+    };
+
+    std::mutex mutex_;
+    std::size_t budget_bytes_;
+    std::size_t used_bytes_ = 0;
+    std::uint64_t hits_ = 0;
+    std::uint64_t misses_ = 0;
+    std::list<std::string> order_;
+    std::unordered_map<std::string, entry> entries_;
+
+    bool erase(const std::string& path) {
+      auto it = entries_.find(path);
+      if (it == entries_.end()) {
+        return false;
+      }
+      used_bytes_ -= it->second.replay->memory_bytes;
+      order_.erase(it->second.position);
+      entries_.erase(it);
+      return true;
+    }
+  };
+
+  void print_json_error(std::FILE* out, std::string_view message) {
+    std::print(out, R"({{"error":)");
+    print_json_string(out, message);
+    std::println(out, "}}");
+  }
+
+  void print_packet_json(std::FILE* out, const framed_packet& packet) {
+    static constexpr char hex_digits[] = "0123456789abcdef";
+    std::print(out, R"({{"index":{},"size":{})", packet.index, packet.data.size());
+    if (packet.header) {
+      std::print(
+        out, R"(,"type":"{}","timestamp_ms":{})",
+        get_packet_type_name(packet.header->packet_type_val).value_or("unknown"),
+        packet.header->timestamp_ms
+      );
+      if (static_cast<packet_type>(packet.header->packet_type_val) == packet_type::mpi) {
+        if (std::optional<mpi_message> mpi = read_mpi_message(packet.payload())) {
+          std::print(out, R"(,"object_id":{},"message_id":{})", mpi->object_id, mpi->message_id);
+        }
+      }
+    }
+    std::span<const std::byte> payload = packet.payload();
+    std::string hex(payload.size() * 2, '0');
+    for (std::size_t i = 0; i < payload.size(); ++i) {
+      auto b = static_cast<std::uint8_t>(payload[i]);
+      hex[2 * i] = hex_digits[b >> 4];
+      hex[2 * i + 1] = hex_digits[b & 0x0F];
+    }
+    std::println(out, R"(,"payload":"{}"}})", hex);
+  }
+
+  std::string_view next_word(std::string_view& text) {
+    std::size_t start = text.find_first_not_of(' ');
+    text.remove_prefix(start == std::string_view::npos ? text.size() : start);
+    std::size_t end = text.find(' ');
+    std::string_view word = text.substr(0, end);
+    text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+    return word;
+  }
+
+  std::optional<std::uint16_t> parse_hex_id(std::string_view text) {
+    if (text.starts_with("0x") || text.starts_with("0X")) {
+      text.remove_prefix(2);
+    }
+    std::uint16_t value = 0;
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value, 16);
+    if (ec != std::errc{} || ptr != text.data() + text.size()) {
+      return std::nullopt;
+    }
+    return value;
+  }
+
+  // One request per line, answered with JSON lines:
+  //   stats <path>                   packet count, time span and memory of one replay, plus the
+  //                                  framing error if the replay is damaged
+  //   packets <path> [filter expr]   one line per packet, filter as for --filter
+  //   object <path> <hex id>         the packets addressed to one MPI object
+  //   evict <path>                   drops a replay from the cache
+  //   cache                          cache occupancy and hit counts
+  // Listings end with {"done":true,"count":N}; failures answer {"error":"..."}.
+  void handle_request(replay_cache& cache, std::string_view line, std::FILE* out) {
+    std::string_view command = next_word(line);
+    if (command == "cache") {
+      cache.print_stats(out);
+      return;
+    }
+
+    std::string path(next_word(line));
+    if (path.empty()) {
+      print_json_error(out, "missing replay path");
+      return;
+    }
+    if (command == "evict") {
+      std::println(out, R"({{"evicted":{}}})", cache.evict(path));
+      return;
+    }
+
+    std::expected<std::shared_ptr<const loaded_replay>, std::string> replay = cache.get(path);
+    if (!replay) {
+      print_json_error(out, replay.error());
+      return;
+    }
+    const std::vector<framed_packet>& packets = (*replay)->packets;
+
+    if (command == "stats") {
+      std::optional<std::uint32_t> first_ms;
+      std::uint32_t last_ms = 0;
+      for (const framed_packet& packet : packets) {
+        if (packet.header) {
+          first_ms = first_ms.value_or(packet.header->timestamp_ms);
+          last_ms = packet.header->timestamp_ms;
+        }
+      }
+      std::print(
+        out, R"({{"packets":{},"objects":{},"first_ms":{},"last_ms":{},"memory_bytes":{})",
+        packets.size(), (*replay)->objects.object_count(), first_ms.value_or(0), last_ms,
+        (*replay)->memory_bytes
+      );
+      if ((*replay)->error) {
+        std::print(out, R"(,"error":)");
+        print_json_string(out, *(*replay)->error);
+      }
+      std::println(out, "}}");
+    } else if (command == "packets") {
+      std::optional<packet_filter> filter = parse_packet_filter(line);
+      if (!filter) {
+        print_json_error(out, "invalid filter expression");
+        return;
+      }
+      std::size_t count = 0;
+      for (const framed_packet& packet : packets) {
+        if (filter->accepts(packet.view())) {
+          print_packet_json(out, packet);
+          count++;
+        }
+      }
+      std::println(out, R"({{"done":true,"count":{}}})", count);
+    } else if (command == "object") {
+      std::optional<std::uint16_t> object_id = parse_hex_id(next_word(line));
+      if (!object_id) {
+        print_json_error(out, "invalid object id");
+        return;
+      }
+      std::vector<packet_location> locations = (*replay)->objects.find(*object_id);
+      for (const packet_location& location : locations) {
+        print_packet_json(out, packets[location.packet_index]);
+      }
+      std::println(out, R"({{"done":true,"count":{}}})", locations.size());
+    } else {
+      print_json_error(out, std::format("unknown command {}", command));
+    }
+  }
+
+#if defined(WRPL_HAS_UNIX_SOCKETS)
+  // Requests are a command and a replay path, so this leaves room for any PATH_MAX path.
+  constexpr std::size_t max_request_size = 8 * 1024;
+
+  enum class request_status {
+    line,
+    end,
+    too_long,
+  };
+
+  // Reads one request line, without its line ending, into `request`, which points into `buffer`.
+  // A line longer than max_request_size is not read to its end.
+  request_status read_request(std::FILE* in, std::vector<char>& buffer, std::string_view& request) {
+    // the longest request, its newline and the terminator
+    buffer.resize(max_request_size + 2);
+    if (!std::fgets(buffer.data(), static_cast<int>(buffer.size()), in)) {
+      return request_status::end;
+    }
+    request = std::string_view(buffer.data());
+    if (!request.ends_with('\n') && (!std::feof(in) || request.size() > max_request_size)) {
+      return request_status::too_long;
+    }
+    while (!request.empty() && (request.back() == '\n' || request.back() == '\r')) {
+      request.remove_suffix(1);
+    }
+    return request_status::line;
+  }
+
+  // Owns a share of the cache, since client threads are detached and may outlive serve().
+  void serve_client(std::shared_ptr<replay_cache> cache, int fd) {
+    std::FILE* in = fdopen(fd, "r");
+    if (!in) {
+      close(fd);
+      return;
+    }
+    std::FILE* out = fdopen(dup(fd), "w");
+    if (!out) {
+      std::fclose(in);
+      return;
+    }
+    std::vector<char> buffer;
+    std::string_view request;
+    request_status status;
+    while ((status = read_request(in, buffer, request)) == request_status::line) {
+      handle_request(*cache, request, out);
+      if (std::fflush(out) != 0) {
+        break;
+      }
+    }
+    if (status == request_status::too_long) {
+      // the rest of the line cannot be told apart from the next request, so the client is dropped
+      print_json_error(out, std::format("request longer than {} bytes", max_request_size));
+    }
+    std::fclose(out);
+    std::fclose(in);
+  }
+#endif
+
+  // Answers queries on a Unix domain socket until the process is killed. Each connection is served
+  // on its own thread; all of them share one cache of parsed replays.
+  export int serve(const std::filesystem::path& socket_path, std::size_t cache_budget_bytes) {
+#if defined(WRPL_HAS_UNIX_SOCKETS)
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::string path = socket_path.string();
+    if (path.size() >= sizeof(address.sun_path)) {
+      std::println(stderr, "Socket path too long: {}", path);
+      return 1;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+      std::println(stderr, "socket: {}", std::strerror(errno));
+      return 1;
+    }
+    // only a stale socket from an earlier run is removed; never a file that happens to be there
+    struct stat existing;
+    if (lstat(path.c_str(), &existing) == 0) {
+      if (!S_ISSOCK(existing.st_mode)) {
+        std::println(stderr, "{} exists and is not a socket", path);
+        close(listener);
+        return 1;
+      }
+      unlink(path.c_str());
+    } else if (errno != ENOENT) {
+      std::println(stderr, "Could not stat {}: {}", path, std::strerror(errno));
+      close(listener);
+      return 1;
+    }
+    if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listener, 16) != 0) {
+      std::println(stderr, "Could not listen on {}: {}", path, std::strerror(errno));
+      close(listener);
+      return 1;
+    }
+    // a client hanging up mid-response must not take the daemon down
+    std::signal(SIGPIPE, SIG_IGN);
+    std::println(stderr, "Listening on {} ({} MB cache)", path, cache_budget_bytes >> 20);
+
+    auto cache = std::make_shared<replay_cache>(cache_budget_bytes);
+    while (true) {
+      int client = accept(listener, nullptr, nullptr);
+      if (client < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        std::println(stderr, "accept: {}", std::strerror(errno));
+        break;
+      }
+      std::thread(serve_client, cache, client).detach();
+    }
+    close(listener);
+    unlink(path.c_str());
+    return 1;
+#else
+    std::println(stderr, "serve needs Unix domain sockets, which this build does not have");
+    return 1;
+#endif
+  }
+
+} // namespace wrpl
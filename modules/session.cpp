@@ -0,0 +1,215 @@
+module;
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+export module session;
+
+import header;
+import parser;
+import stream_scan;
+import trace;
+
+namespace wrpl {
+
+  export struct session_segment {
+    std::size_t file_index;
+    std::size_t offset;
+    std::uint64_t compressed_size;
+    std::size_t packet_count;
+    // why framing stopped early; the packets framed before it are kept
+    std::error_code error;
+  };
+
+  export struct session {
+    std::vector<std::filesystem::path> files;
+    std::vector<session_segment> segments;
+    std::vector<framed_packet> packets;
+  };
+
+  bool is_segment_number(const std::string& stem) {
+    return !stem.empty() && std::ranges::all_of(stem, [](unsigned char c) {
+      return std::isdigit(c) != 0;
+    });
+  }
+
+  // Server replays are written as numbered files (0000.wrpl, 0001.wrpl, ...) in one directory.
+  // Returns all numbered siblings of `path` in order, or just `path` if it is not numbered.
+  export std::vector<std::filesystem::path>
+  discover_session_files(const std::filesystem::path& path) {
+    std::string stem = path.stem().string();
+    if (!is_segment_number(stem)) {
+      return {path};
+    }
+
+    std::filesystem::path directory = path.parent_path();
+    if (directory.empty()) {
+      directory = ".";
+    }
+
+    std::error_code ec;
+    std::filesystem::directory_iterator it(directory, ec);
+    if (ec) {
+      return {path};
+    }
+    std::vector<std::filesystem::path> files;
+    for (; it != std::filesystem::directory_iterator(); it.increment(ec)) {
+      if (ec) {
+        break;
+      }
+      const std::filesystem::path& candidate = it->path();
+      std::string candidate_stem = candidate.stem().string();
+      if (it->is_regular_file(ec) && candidate.extension() == path.extension() &&
+          candidate_stem.size() == stem.size() && is_segment_number(candidate_stem)) {
+        files.push_back(candidate);
+      }
+    }
+    std::ranges::sort(files);
+    return files;
+  }
+
+  struct segment_result {
+    std::size_t offset = 0;
+    std::vector<framed_packet> packets;
+    std::uint64_t compressed_size = 0;
+    bool complete = false;
+    std::error_code error;
+  };
+
+  struct file_segments {
+    std::vector<std::byte> data;
+    std::vector<segment_result> segments;
+  };
+
+  void decode_segment(std::span<const std::byte> data, segment_result& segment) {
+    trace_span span("decode segment");
+    memory_istream stream(data);
+    packet_framer framer(stream);
+    auto packet = framer.next();
+    for (; packet && *packet; packet = framer.next()) {
+      segment.packets.push_back(std::move(**packet));
+    }
+    if (!packet) {
+      segment.error = packet.error();
+    }
+  }
+
+  // Finds the segments of one file from where their streams end, which decides which of the
+  // following candidates are real. A stream that reaches its trailer is left for read_session to
+  // frame; a damaged one is framed here, since its packet count decides whether it is a segment.
+  file_segments locate_file_segments(const std::filesystem::path& path) {
+    trace_span span("locate segments");
+    file_segments file;
+    std::optional<std::vector<std::byte>> data = read_replay_file(path);
+    if (!data) {
+      return file;
+    }
+    file.data = std::move(*data);
+    std::span<const std::byte> bytes(file.data);
+    for_each_zlib_stream(bytes, replay_header_size, [&](std::size_t offset) -> std::uint64_t {
+      zlib_extent extent = zlib_stream_extent(bytes.subspan(offset));
+      segment_result segment;
+      segment.offset = offset;
+      segment.compressed_size = extent.compressed_size;
+      segment.complete = extent.complete;
+      if (!extent.complete) {
+        decode_segment(bytes.subspan(offset), segment);
+        if (!is_segment(false, segment.packets.size())) {
+          return 0;
+        }
+      }
+      file.segments.push_back(std::move(segment));
+      return extent.compressed_size;
+    });
+    return file;
+  }
+
+  // Locates the segments of every file, then frames all of them on all cores. Packets are then
+  // renumbered and timestamps made continuous across segments.
+  export session read_session(const std::vector<std::filesystem::path>& files) {
+    session result;
+    result.files = files;
+
+    std::vector<file_segments> decoded(files.size());
+    std::size_t max_workers = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    {
+      std::atomic<std::size_t> next_file{0};
+      std::size_t worker_count = std::min(max_workers, std::max<std::size_t>(files.size(), 1));
+      std::vector<std::jthread> workers;
+      for (std::size_t w = 0; w < worker_count; ++w) {
+        workers.emplace_back([&] {
+          for (std::size_t i = next_file++; i < files.size(); i = next_file++) {
+            decoded[i] = locate_file_segments(files[i]);
+          }
+        });
+      }
+    }
+
+    std::vector<std::pair<std::span<const std::byte>, segment_result*>> pending;
+    for (file_segments& file : decoded) {
+      for (segment_result& segment : file.segments) {
+        if (segment.complete) {
+          std::span<const std::byte> bytes(file.data);
+          pending.emplace_back(bytes.subspan(segment.offset, segment.compressed_size), &segment);
+        }
+      }
+    }
+    {
+      std::atomic<std::size_t> next_segment{0};
+      std::size_t worker_count = std::min(max_workers, std::max<std::size_t>(pending.size(), 1));
+      std::vector<std::jthread> workers;
+      for (std::size_t w = 0; w < worker_count; ++w) {
+        workers.emplace_back([&] {
+          for (std::size_t i = next_segment++; i < pending.size(); i = next_segment++) {
+            decode_segment(pending[i].first, *pending[i].second);
+          }
+        });
+      }
+    }
+
+    std::optional<std::uint32_t> last_timestamp_ms;
+    std::uint32_t packet_index = 0;
+    for (std::size_t file_index = 0; file_index < files.size(); ++file_index) {
+      for (segment_result& segment : decoded[file_index].segments) {
+        if (!is_segment(segment.complete, segment.packets.size())) {
+          continue;
+        }
+        std::uint32_t timestamp_offset = 0;
+        auto first = std::ranges::find_if(segment.packets, [](const framed_packet& packet) {
+          return packet.header.has_value();
+        });
+        if (last_timestamp_ms && first != segment.packets.end() &&
+            first->header->timestamp_ms < *last_timestamp_ms) {
+          timestamp_offset = *last_timestamp_ms - first->header->timestamp_ms;
+        }
+
+        result.segments.push_back(
+          {file_index, segment.offset, segment.compressed_size, segment.packets.size(),
+           segment.error}
+        );
+        for (framed_packet& packet : segment.packets) {
+          packet.index = packet_index++;
+          if (packet.header) {
+            packet.header->timestamp_ms += timestamp_offset;
+            last_timestamp_ms =
+              std::max(last_timestamp_ms.value_or(0), packet.header->timestamp_ms);
+          }
+          result.packets.push_back(std::move(packet));
+        }
+      }
+    }
+    return result;
+  }
+
+} // namespace wrpl
@@ -0,0 +1,207 @@
+module;
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <span>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+export module stream_scan;
+
+namespace wrpl {
+
+  constexpr std::uint8_t zlib_cmf = 0x78; // CM=8 (deflate), CINFO=7
+
+  // Index of the next byte equal to `zlib_cmf` at or after `pos`, or `data.size()`.
+  std::size_t find_next_cmf(std::span<const std::byte> data, std::size_t pos) {
+    const auto* bytes = reinterpret_cast<const std::uint8_t*>(data.data());
+    std::size_t size = data.size();
+
+#if defined(__AVX2__)
+    const __m256i needle = _mm256_set1_epi8(static_cast<char>(zlib_cmf));
+    for (; pos + 32 <= size; pos += 32) {
+      __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes + pos));
+      auto mask =
+        static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle)));
+      if (mask != 0) {
+        return pos + std::countr_zero(mask);
+      }
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128i needle = _mm_set1_epi8(static_cast<char>(zlib_cmf));
+    for (; pos + 16 <= size; pos += 16) {
+      __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + pos));
+      auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)));
+      if (mask != 0) {
+        return pos + std::countr_zero(mask);
+      }
+    }
+#elif defined(__wasm_simd128__)
+    const v128_t needle = wasm_i8x16_splat(static_cast<std::int8_t>(zlib_cmf));
+    for (; pos + 16 <= size; pos += 16) {
+      v128_t chunk = wasm_v128_load(bytes + pos);
+      auto mask = static_cast<std::uint32_t>(wasm_i8x16_bitmask(wasm_i8x16_eq(chunk, needle)));
+      if (mask != 0) {
+        return pos + std::countr_zero(mask);
+      }
+    }
+#endif
+
+    for (; pos < size; ++pos) {
+      if (bytes[pos] == zlib_cmf) {
+        return pos;
+      }
+    }
+    return size;
+  }
+
+  // rfc 1950 2.2: checksum valid and no preset dictionary
+  bool is_valid_zlib_header(std::uint8_t cmf, std::uint8_t flg) {
+    return (cmf * 256u + flg) % 31 == 0 && (flg & 0x20) == 0;
+  }
+
+  // Inflates the first few KiB behind a candidate header. A false positive header hits a data
+  // error there almost always; stopping after the first block would still let about one in a
+  // hundred random buffers through, since a fixed Huffman block of random bits often ends cleanly.
+  bool trial_inflate(std::span<const std::byte> data) {
+    constexpr std::size_t trial_input_size = 4 * 1024;
+    constexpr std::size_t trial_output_size = 16 * 1024;
+    std::span<const std::byte> input = data.first(std::min(data.size(), trial_input_size));
+    std::vector<std::byte> output(trial_output_size);
+
+    z_stream stream{};
+    if (inflateInit(&stream) != Z_OK) {
+      return false;
+    }
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<std::byte*>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+    stream.next_out = reinterpret_cast<Bytef*>(output.data());
+    stream.avail_out = static_cast<uInt>(output.size());
+
+    // stops at the end of the stream, when the input runs out or the output is full, or at the
+    // first error; Z_DATA_ERROR and Z_NEED_DICT reject the candidate
+    int ret = inflate(&stream, Z_NO_FLUSH);
+    inflateEnd(&stream);
+    return ret == Z_OK || ret == Z_STREAM_END || ret == Z_BUF_ERROR;
+  }
+
+  // Offsets of zlib streams in `data` at or after `start`, in file order. Candidate headers are
+  // located with a vectorized byte scan, then checked with FCHECK and a trial inflate.
+  export std::vector<std::size_t> find_zlib_streams(
+    std::span<const std::byte> data, std::size_t start,
+    std::size_t max_count = std::numeric_limits<std::size_t>::max()
+  ) {
+    std::vector<std::size_t> offsets;
+    std::size_t pos = start;
+    while (offsets.size() < max_count && pos + 1 < data.size()) {
+      pos = find_next_cmf(data, pos);
+      if (pos + 1 >= data.size()) {
+        break;
+      }
+      auto flg = static_cast<std::uint8_t>(data[pos + 1]);
+      if (is_valid_zlib_header(zlib_cmf, flg) && trial_inflate(data.subspan(pos))) {
+        offsets.push_back(pos);
+      }
+      pos++;
+    }
+    return offsets;
+  }
+
+  export struct zlib_extent {
+    // compressed bytes up to the trailer, or up to where the stream turned out to be damaged or
+    // truncated
+    std::size_t compressed_size = 0;
+    // inflating reached the trailer and its checksum matched
+    bool complete = false;
+  };
+
+  // How far the zlib stream at the start of `data` reaches. The inflated bytes go to a scratch
+  // buffer.
+  export zlib_extent zlib_stream_extent(std::span<const std::byte> data) {
+    std::vector<std::byte> scratch(32 * 1024);
+    z_stream stream{};
+    if (inflateInit(&stream) != Z_OK) {
+      return {};
+    }
+    std::size_t fed = 0;
+    int ret = Z_OK;
+    while (ret == Z_OK) {
+      if (stream.avail_in == 0) {
+        std::size_t chunk =
+          std::min<std::size_t>(data.size() - fed, std::numeric_limits<uInt>::max());
+        if (chunk == 0) {
+          break;
+        }
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<std::byte*>(data.data() + fed));
+        stream.avail_in = static_cast<uInt>(chunk);
+        fed += chunk;
+      }
+      stream.next_out = reinterpret_cast<Bytef*>(scratch.data());
+      stream.avail_out = static_cast<uInt>(scratch.size());
+      ret = inflate(&stream, Z_NO_FLUSH);
+    }
+    zlib_extent extent{static_cast<std::size_t>(stream.total_in), ret == Z_STREAM_END};
+    inflateEnd(&stream);
+    return extent;
+  }
+
+  // A damaged or truncated stream needs this many framed packets to count as a segment; below
+  // that, a candidate that never reaches its trailer is taken for a false header.
+  export constexpr std::size_t min_damaged_segment_packets = 16;
+
+  // Whether a candidate that framed `packet_count` packets is a real segment of the file.
+  export bool is_segment(bool complete, std::size_t packet_count) {
+    return packet_count > 0 && (complete || packet_count >= min_damaged_segment_packets);
+  }
+
+  // Walks the zlib streams of one file in order, starting the search at `start`. `decode` gets
+  // the offset of each candidate and returns the compressed size of the stream it decoded there,
+  // or 0 if the candidate turned out not to be a stream. The search resumes behind a decoded
+  // stream, so headers inside its compressed data are never trial inflated.
+  export void for_each_zlib_stream(
+    std::span<const std::byte> data, std::size_t start,
+    const std::function<std::uint64_t(std::size_t offset)>& decode
+  ) {
+    std::size_t pos = start;
+    while (true) {
+      std::vector<std::size_t> next = find_zlib_streams(data, pos, 1);
+      if (next.empty()) {
+        break;
+      }
+      std::size_t offset = next.front();
+      pos = std::max<std::size_t>(offset + 1, offset + decode(offset));
+    }
+  }
+
+  // The whole content of a replay file, or nullopt if it cannot be opened or read.
+  export std::optional<std::vector<std::byte>> read_replay_file(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+      return std::nullopt;
+    }
+    std::vector<std::byte> data(static_cast<std::size_t>(file.tellg()));
+    file.seekg(0, std::ios::beg);
+    auto size = static_cast<std::streamsize>(data.size());
+    if (!file.read(reinterpret_cast<char*>(data.data()), size)) {
+      return std::nullopt;
+    }
+    return data;
+  }
+
+} // namespace wrpl
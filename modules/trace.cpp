@@ -0,0 +1,131 @@
+module;
+
+#include <print>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+
+export module trace;
+
+namespace wrpl {
+
+#if defined(WRPL_TRACE)
+  export constexpr bool tracing_enabled = true;
+#else
+  export constexpr bool tracing_enabled = false;
+#endif
+
+  struct trace_event {
+    const char* name;
+    std::uint64_t start_ns;
+    std::uint64_t duration_ns;
+  };
+
+  // Events of one thread. Only the owning thread writes, so appending is a store plus a release
+  // increment of `written`; once more than `capacity` events arrive the oldest are overwritten.
+  // Rings are never freed, so the events of finished threads are still there at exit.
+  struct trace_ring {
+    static constexpr std::size_t capacity = 1 << 16;
+
+    std::array<trace_event, capacity> events;
+    std::atomic<std::uint64_t> written{0};
+    std::uint32_t thread_id = 0;
+    trace_ring* next = nullptr;
+
+    void append(const trace_event& event) {
+      std::uint64_t index = written.load(std::memory_order_relaxed);
+      events[index % capacity] = event;
+      written.store(index + 1, std::memory_order_release);
+    }
+  };
+
+  // every ring ever created, pushed lock-free by the thread that owns it
+  std::atomic<trace_ring*> all_rings{nullptr};
+  std::atomic<std::uint32_t> next_thread_id{1};
+  thread_local trace_ring* thread_ring = nullptr;
+
+  trace_ring& current_ring() {
+    if (!thread_ring) {
+      thread_ring = new trace_ring;
+      thread_ring->thread_id = next_thread_id.fetch_add(1, std::memory_order_relaxed);
+      thread_ring->next = all_rings.load(std::memory_order_relaxed);
+      while (!all_rings.compare_exchange_weak(
+        thread_ring->next, thread_ring, std::memory_order_release, std::memory_order_relaxed
+      )) {
+      }
+    }
+    return *thread_ring;
+  }
+
+  std::uint64_t trace_clock_ns() {
+    static const auto epoch = std::chrono::steady_clock::now();
+    return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - epoch
+      )
+        .count()
+    );
+  }
+
+  // Records the time between construction and destruction as one span on the calling thread.
+  // `name` must outlive the program, i.e. be a string literal. Compiles to nothing unless
+  // WRPL_TRACE is defined.
+  export class trace_span {
+public:
+    explicit trace_span([[maybe_unused]] const char* name) {
+#if defined(WRPL_TRACE)
+      name_ = name;
+      start_ns_ = trace_clock_ns();
+#endif
+    }
+
+    ~trace_span() {
+#if defined(WRPL_TRACE)
+      std::uint64_t end_ns = trace_clock_ns();
+      current_ring().append({name_, start_ns_, end_ns - start_ns_});
+#endif
+    }
+
+    trace_span(const trace_span&) = delete;
+    trace_span& operator=(const trace_span&) = delete;
+
+private:
+#if defined(WRPL_TRACE)
+    const char* name_;
+    std::uint64_t start_ns_;
+#endif
+  };
+
+  // Writes every recorded span as a Chrome trace ("X" complete events, microsecond timestamps)
+  // that chrome://tracing and Perfetto open directly. Call it once the traced threads are done;
+  // spans still being written by running threads may come out torn.
+  export bool write_chrome_trace(const std::filesystem::path& path) {
+    std::FILE* out = std::fopen(path.string().c_str(), "w");
+    if (!out) {
+      return false;
+    }
+    std::print(out, R"({{"displayTimeUnit":"ns","traceEvents":[)");
+    bool first = true;
+    for (trace_ring* ring = all_rings.load(std::memory_order_acquire); ring; ring = ring->next) {
+      std::uint64_t written = ring->written.load(std::memory_order_acquire);
+      std::uint64_t begin = written > trace_ring::capacity ? written - trace_ring::capacity : 0;
+      for (std::uint64_t i = begin; i < written; ++i) {
+        const trace_event& event = ring->events[i % trace_ring::capacity];
+        std::print(
+          out, R"({}{{"name":"{}","ph":"X","pid":1,"tid":{},"ts":{:.3f},"dur":{:.3f}}})",
+          first ? "\n" : ",\n", event.name, ring->thread_id,
+          static_cast<double>(event.start_ns) / 1e3, static_cast<double>(event.duration_ns) / 1e3
+        );
+        first = false;
+      }
+    }
+    std::println(out, "\n]}}");
+    return std::fclose(out) == 0;
+  }
+
+} // namespace wrpl
@@ -1,62 +1,570 @@
 #include <print>
 
+#include <charconv>
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <exception>
 #include <filesystem>
 #include <fstream>
+#include <iterator>
+#include <limits>
+#include <memory>
 #include <optional>
-#include <sstream>
+#include <span>
+#include <string>
 #include <string_view>
+#include <system_error>
+#include <utility>
 #include <vector>
 
+import aggregate;
+import archive_index;
+import chat;
+import follow;
+import header;
+import memory_stats;
+import merge;
+import object_index;
 import parser;
+import serve;
+import session;
+import stream_scan;
+import trace;
 
 std::optional<std::string_view> find_stream(std::string_view file_data) {
-  constexpr std::size_t replay_header_size = 0x4C6;
-  if (file_data.size() < replay_header_size + 2)
+  std::vector<std::size_t> offsets =
+    wrpl::find_zlib_streams(std::as_bytes(std::span(file_data)), wrpl::replay_header_size, 1);
+  if (offsets.empty()) {
     return std::nullopt;
+  }
+  return file_data.substr(offsets.front());
+}
+
+std::optional<std::uint16_t> parse_object_id(std::string_view text) {
+  if (text.starts_with("0x") || text.starts_with("0X")) {
+    text.remove_prefix(2);
+  }
+  std::uint16_t value = 0;
+  auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value, 16);
+  if (ec != std::errc{} || ptr != text.data() + text.size()) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+std::optional<wrpl::object_index> load_object_index(const std::filesystem::path& index_path) {
+  std::ifstream file(index_path, std::ios::binary);
+  if (!file) {
+    return std::nullopt;
+  }
+  std::vector<char> buffer{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+  return wrpl::object_index::deserialize(std::as_bytes(std::span(buffer)));
+}
 
-  for (std::size_t i = replay_header_size; i + 1 < file_data.size(); ++i) {
-    auto cmf = static_cast<std::uint8_t>(file_data[i]);
-    auto flg = static_cast<std::uint8_t>(file_data[i + 1]);
-    // rfc 1950 2.2: CM=8 (deflate), CINFO=7, checksum valid
-    if (cmf == 0x78 && (cmf * 256u + flg) % 31 == 0) {
-      return file_data.substr(i);
+bool save_object_index(const std::filesystem::path& index_path, const wrpl::object_index& index) {
+  std::vector<std::byte> data = index.serialize();
+  std::ofstream file(index_path, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+  return static_cast<bool>(file);
+}
+
+// Reads only the fixed header, so cataloging an archive never touches the packet stream.
+int print_headers(const std::vector<const char*>& paths, bool json) {
+  int result = 0;
+  std::vector<std::byte> buffer(wrpl::replay_header_size);
+  for (const char* path : paths) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.read(reinterpret_cast<char*>(buffer.data()), buffer.size())) {
+      std::println(stderr, "Could not read replay header from {}", path);
+      result = 1;
+      continue;
+    }
+    std::optional<wrpl::replay_header> header = wrpl::parse_replay_header(buffer);
+    if (!header) {
+      std::println(stderr, "Invalid replay header in {}", path);
+      result = 1;
+      continue;
     }
+    wrpl::print_replay_header(path, *header, json);
   }
-  return std::nullopt;
+  return result;
 }
 
-int main(int argc, char* argv[]) {
-  if (argc != 2) {
-    std::println(stderr, "Usage: {} <path_wrpl>", argv[0]);
+int print_session(const std::filesystem::path& path) {
+  std::vector<std::filesystem::path> files = wrpl::discover_session_files(path);
+  wrpl::session session = wrpl::read_session(files);
+  if (session.segments.empty()) {
+    std::println(stderr, "No replay segments found for {}", path.string());
     return 1;
   }
 
-  try {
-    const std::filesystem::path wrpl_path = argv[1];
-    if (!std::filesystem::exists(wrpl_path)) {
-      std::println(stderr, "File not found at {}", wrpl_path.string());
+  std::println("Session: {} files, {} segments", files.size(), session.segments.size());
+  for (const wrpl::session_segment& segment : session.segments) {
+    std::println(
+      "  {} at offset {:#x}: {} compressed bytes, {} packets",
+      files[segment.file_index].string(), segment.offset, segment.compressed_size,
+      segment.packet_count
+    );
+    if (segment.error) {
+      std::println(
+        stderr, "{} at offset {:#x}: stopped after {} packets: {}",
+        files[segment.file_index].string(), segment.offset, segment.packet_count,
+        segment.error.message()
+      );
+    }
+  }
+  for (const wrpl::framed_packet& packet : session.packets) {
+    wrpl::print_packet(packet);
+  }
+  return 0;
+}
+
+std::optional<std::vector<char>> read_replay(const std::filesystem::path& wrpl_path) {
+  if (!std::filesystem::exists(wrpl_path)) {
+    std::println(stderr, "File not found at {}", wrpl_path.string());
+    return std::nullopt;
+  }
+
+  std::ifstream file(wrpl_path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    std::println(stderr, "Could not open file {}", wrpl_path.string());
+    return std::nullopt;
+  }
+
+  std::streamsize size = file.tellg();
+  file.seekg(0, std::ios::beg);
+  std::vector<char> buffer(size);
+  if (!file.read(buffer.data(), size)) {
+    std::println(stderr, "Could not read file content from {}", wrpl_path.string());
+    return std::nullopt;
+  }
+  return buffer;
+}
+
+int merge_replays(const std::vector<const char*>& paths) {
+  std::vector<std::vector<char>> buffers;
+  std::vector<std::unique_ptr<wrpl::memory_istream>> streams;
+  std::vector<std::istream*> sources;
+  for (const char* path : paths) {
+    std::optional<std::vector<char>> buffer = read_replay(path);
+    if (!buffer) {
+      return 1;
+    }
+    std::optional<std::string_view> zlib_data =
+      find_stream(std::string_view(buffer->data(), buffer->size()));
+    if (!zlib_data) {
+      std::println(stderr, "Zlib stream not found in {}", path);
       return 1;
     }
+    streams.push_back(
+      std::make_unique<wrpl::memory_istream>(std::as_bytes(std::span(*zlib_data)))
+    );
+    sources.push_back(streams.back().get());
+    buffers.push_back(std::move(*buffer));
+  }
+
+  wrpl::replay_merger merger(sources);
+  while (std::optional<wrpl::tagged_packet> tagged = merger.next()) {
+    std::print("\n[{}]", paths[tagged->source]);
+    wrpl::print_packet(tagged->packet);
+  }
+  int status = 0;
+  for (std::size_t i = 0; i < paths.size(); ++i) {
+    if (std::error_code error = merger.error(i)) {
+      std::println(stderr, "{}: stopped early: {}", paths[i], error.message());
+      status = 1;
+    }
+  }
+  return status;
+}
+
+int print_aggregates(
+  const std::vector<const char*>& paths, const std::vector<wrpl::group_by>& group_bys,
+  const wrpl::packet_filter& filter, bool json
+) {
+  std::vector<std::filesystem::path> files(paths.begin(), paths.end());
+  wrpl::aggregate_result result = wrpl::aggregate_replays(files, group_bys, filter);
+  for (const std::string& error : result.errors) {
+    std::println(stderr, "{}", error);
+  }
+  wrpl::print_aggregates(result.totals, json);
+  return result.errors.empty() ? 0 : 1;
+}
 
-    std::ifstream file(wrpl_path, std::ios::binary | std::ios::ate);
-    if (!file) {
-      std::println(stderr, "Could not open file {}", wrpl_path.string());
+// Prints packets of a replay that is still being recorded as soon as they are written.
+int print_followed_replay(const std::filesystem::path& path, const wrpl::packet_filter& filter) {
+  std::error_code error =
+    wrpl::follow_replay(path, {.filter = filter}, [](const wrpl::packet_view& packet) {
+      wrpl::print_packet(packet);
+      wrpl::trace_span span("flush stdout");
+      std::fflush(stdout);
+    });
+  if (error) {
+    std::println(stderr, "Stopped following {}: {}", path.string(), error.message());
+    return 1;
+  }
+  return 0;
+}
+
+// Resumes from `checkpoint_path` if it exists, prints up to `stop_after` packets and saves where
+// it stopped, so a replay can be ingested in slices across runs. A checkpoint taken from a replay
+// with another size or mtime than `source` is refused.
+int process_with_checkpoint(
+  std::istream& zlib_stream, const wrpl::packet_filter& filter,
+  const std::filesystem::path& checkpoint_path, std::uint64_t stop_after,
+  const wrpl::replay_stamp& source
+) {
+  std::optional<wrpl::packet_framer> framer;
+  std::ifstream checkpoint_file(checkpoint_path, std::ios::binary);
+  if (checkpoint_file) {
+    std::vector<char> blob{
+      std::istreambuf_iterator<char>(checkpoint_file), std::istreambuf_iterator<char>()
+    };
+    std::optional<wrpl::decoder_checkpoint> checkpoint =
+      wrpl::decoder_checkpoint::deserialize(std::as_bytes(std::span(blob)));
+    if (!checkpoint) {
+      std::println(stderr, "Invalid checkpoint in {}", checkpoint_path.string());
+      return 1;
+    }
+    if (wrpl::replay_stamp{checkpoint->source_size, checkpoint->source_modified} != source) {
+      std::println(
+        stderr, "Checkpoint {} belongs to another version of this replay; delete it to restart",
+        checkpoint_path.string()
+      );
       return 1;
     }
+    framer.emplace(zlib_stream, *checkpoint, filter);
+  } else {
+    framer.emplace(zlib_stream, filter);
+    framer->track_checkpoints();
+  }
+
+  if (!wrpl::process_stream(*framer, stop_after)) {
+    std::error_code ec;
+    std::filesystem::remove(checkpoint_path, ec);
+    return 0;
+  }
+  wrpl::decoder_checkpoint checkpoint = framer->checkpoint();
+  checkpoint.source_size = source.size;
+  checkpoint.source_modified = source.modified;
+  std::optional<std::vector<std::byte>> blob = checkpoint.serialize();
+  if (!blob) {
+    std::println(stderr, "Could not compress checkpoint for {}", checkpoint_path.string());
+    return 1;
+  }
+  std::ofstream out(checkpoint_path, std::ios::binary | std::ios::trunc);
+  out.write(
+    reinterpret_cast<const char*>(blob->data()), static_cast<std::streamsize>(blob->size())
+  );
+  if (!out) {
+    std::println(stderr, "Could not write checkpoint to {}", checkpoint_path.string());
+    return 1;
+  }
+  return 0;
+}
 
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
-    std::vector<char> buffer(size);
-    if (!file.read(buffer.data(), size)) {
-      std::println(stderr, "Could not read file content from {}", wrpl_path.string());
+enum class run_mode {
+  header_only,
+  merge,
+  session,
+  dump,
+  object,
+  chat,
+  follow,
+  aggregate,
+};
+
+// wrpl serve <socket_path> [--cache-mb <n>]
+int run_serve(int argc, char* argv[]) {
+  std::optional<std::filesystem::path> socket_path;
+  std::size_t cache_mb = 1024;
+  for (int i = 2; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--cache-mb" && i + 1 < argc) {
+      std::string_view value = argv[++i];
+      auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), cache_mb);
+      // the budget is passed on in bytes, so it has to fit after the shift
+      if (ec != std::errc{} || ptr != value.data() + value.size() || cache_mb > SIZE_MAX >> 20) {
+        std::println(stderr, "Invalid cache size: {}", value);
+        return 1;
+      }
+    } else {
+      socket_path = arg;
+    }
+  }
+  if (!socket_path) {
+    std::println(stderr, "Usage: {} serve <socket_path> [--cache-mb <n>]", argv[0]);
+    return 1;
+  }
+  return wrpl::serve(*socket_path, cache_mb << 20);
+}
+
+// Writes the Chrome trace to `path` at exit, so every mode and every early return gets it.
+bool install_trace_writer(const std::filesystem::path& path) {
+  if (!wrpl::tracing_enabled) {
+    std::println(stderr, "Tracing is not compiled in (configure with -DWRPL_TRACE=ON)");
+    return false;
+  }
+  static std::filesystem::path trace_output;
+  trace_output = path;
+  std::atexit([] {
+    if (!wrpl::write_chrome_trace(trace_output)) {
+      std::println(stderr, "Could not write trace to {}", trace_output.string());
+    }
+  });
+  return true;
+}
+
+// wrpl index build [--trace <file>] <index_file> <path>...
+// wrpl index query [--trace <file>] <index_file> <term>...
+int run_index(int argc, char* argv[]) {
+  std::string_view command = argc >= 3 ? argv[2] : "";
+  std::optional<std::filesystem::path> trace_path;
+  std::optional<std::filesystem::path> index_file;
+  std::vector<std::string> args;
+  for (int i = 3; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--trace" && i + 1 < argc) {
+      trace_path = argv[++i];
+    } else if (!index_file) {
+      index_file = arg;
+    } else {
+      args.emplace_back(arg);
+    }
+  }
+  if (!index_file || args.empty() || (command != "build" && command != "query")) {
+    std::println(
+      stderr,
+      "Usage: {} index build [--trace <file>] <index_file> <path_wrpl_or_dir>...\n"
+      "       {} index query [--trace <file>] <index_file> <term>...",
+      argv[0], argv[0]
+    );
+    return 1;
+  }
+  if (trace_path && !install_trace_writer(*trace_path)) {
+    return 1;
+  }
+  const std::filesystem::path& index_path = *index_file;
+
+  std::optional<wrpl::archive_index> index;
+  std::ifstream file(index_path, std::ios::binary);
+  if (file) {
+    std::vector<char> buffer{
+      std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()
+    };
+    index = wrpl::archive_index::deserialize(std::as_bytes(std::span(buffer)));
+    if (!index) {
+      std::println(stderr, "Invalid archive index in {}", index_path.string());
+      return 1;
+    }
+  } else if (command == "query") {
+    std::println(stderr, "Could not open archive index {}", index_path.string());
+    return 1;
+  } else {
+    index.emplace();
+  }
+
+  if (command == "query") {
+    std::optional<std::vector<std::uint32_t>> matches = index->query(args);
+    if (!matches) {
+      std::println(stderr, "Invalid query term");
+      return 1;
+    }
+    for (std::uint32_t replay_id : *matches) {
+      std::println("{}", index->path(replay_id));
+    }
+    return 0;
+  }
+
+  std::vector<std::filesystem::path> paths(args.begin(), args.end());
+  wrpl::index_update_stats stats = index->update(wrpl::find_replay_files(paths));
+  for (const std::string& error : stats.errors) {
+    std::println(stderr, "{}", error);
+  }
+
+  // written next to the index and renamed over it, so a failed run never leaves half an index
+  std::filesystem::path temp_path = index_path;
+  temp_path += ".tmp";
+  std::vector<std::byte> data = index->serialize();
+  {
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    out.write(
+      reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size())
+    );
+    if (!out) {
+      std::println(stderr, "Could not write archive index to {}", temp_path.string());
       return 1;
     }
+  }
+  std::error_code ec;
+  std::filesystem::rename(temp_path, index_path, ec);
+  if (ec) {
+    std::println(stderr, "Could not replace {}: {}", index_path.string(), ec.message());
+    return 1;
+  }
+  std::println(
+    "{} added, {} updated, {} removed, {} unchanged; {} replays, {} terms", stats.added,
+    stats.updated, stats.removed, stats.unchanged, index->replay_count(), index->term_count()
+  );
+  return stats.errors.empty() ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc >= 2 && std::string_view(argv[1]) == "serve") {
+    return run_serve(argc, argv);
+  }
+  if (argc >= 2 && std::string_view(argv[1]) == "index") {
+    return run_index(argc, argv);
+  }
+
+  run_mode mode = run_mode::dump;
+  std::optional<std::uint16_t> object_id;
+  wrpl::packet_filter filter;
+  bool has_filter = false;
+  bool json = false;
+  std::optional<std::filesystem::path> checkpoint_path;
+  std::optional<std::uint64_t> stop_after;
+  std::vector<wrpl::group_by> group_bys;
+  bool memory_stats = false;
+  std::optional<std::filesystem::path> trace_path;
+  std::vector<const char*> paths;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--object" && i + 1 < argc) {
+      object_id = parse_object_id(argv[++i]);
+      if (!object_id) {
+        std::println(stderr, "Invalid object id: {}", argv[i]);
+        return 1;
+      }
+      mode = run_mode::object;
+    } else if (arg == "--chat") {
+      mode = run_mode::chat;
+    } else if (arg == "--merge") {
+      mode = run_mode::merge;
+    } else if (arg == "--session") {
+      mode = run_mode::session;
+    } else if (arg == "--follow") {
+      mode = run_mode::follow;
+    } else if (arg == "--aggregate" && i + 1 < argc) {
+      std::optional<std::vector<wrpl::group_by>> parsed = wrpl::parse_group_bys(argv[++i]);
+      if (!parsed) {
+        std::println(stderr, "Invalid group-by expression: {}", argv[i]);
+        return 1;
+      }
+      group_bys = std::move(*parsed);
+      mode = run_mode::aggregate;
+    } else if (arg == "--header-only") {
+      mode = run_mode::header_only;
+    } else if (arg == "--json") {
+      json = true;
+    } else if (arg == "--memory-stats") {
+      memory_stats = true;
+    } else if (arg == "--trace" && i + 1 < argc) {
+      trace_path = argv[++i];
+    } else if (arg == "--filter" && i + 1 < argc) {
+      std::optional<wrpl::packet_filter> parsed = wrpl::parse_packet_filter(argv[++i]);
+      if (!parsed) {
+        std::println(stderr, "Invalid filter expression: {}", argv[i]);
+        return 1;
+      }
+      filter = *parsed;
+      has_filter = true;
+    } else if (arg == "--checkpoint" && i + 1 < argc) {
+      checkpoint_path = argv[++i];
+    } else if (arg == "--stop-after" && i + 1 < argc) {
+      std::string_view value = argv[++i];
+      std::uint64_t count = 0;
+      auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), count);
+      if (ec != std::errc{} || ptr != value.data() + value.size()) {
+        std::println(stderr, "Invalid packet count: {}", value);
+        return 1;
+      }
+      stop_after = count;
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
 
-    std::println("Read {} bytes from {}", size, wrpl_path.string());
-    std::string_view file_content(buffer.data(), size);
+  // the other modes pick their packets themselves and would silently drop the filter
+  if (has_filter && mode != run_mode::dump && mode != run_mode::follow &&
+      mode != run_mode::aggregate) {
+    std::println(stderr, "--filter only applies to packet dumps, --follow and --aggregate");
+    return 1;
+  }
+  if ((checkpoint_path || stop_after) && mode != run_mode::dump) {
+    std::println(stderr, "--checkpoint and --stop-after only apply to packet dumps");
+    return 1;
+  }
+  if (json && mode != run_mode::chat && mode != run_mode::header_only &&
+      mode != run_mode::aggregate) {
+    std::println(stderr, "--json only applies to --chat, --header-only and --aggregate");
+    return 1;
+  }
+
+  if (memory_stats) {
+    // at exit, so every mode and every early return gets the report
+    std::atexit([] {
+      wrpl::print_memory_report(stderr);
+    });
+  }
+
+  if (trace_path && !install_trace_writer(*trace_path)) {
+    return 1;
+  }
+
+  if (mode == run_mode::header_only && !paths.empty()) {
+    return print_headers(paths, json);
+  }
+
+  if (mode == run_mode::aggregate && !paths.empty()) {
+    return print_aggregates(paths, group_bys, filter, json);
+  }
+
+  if (mode == run_mode::merge && paths.size() >= 2) {
+    try {
+      return merge_replays(paths);
+    } catch (const std::exception& e) {
+      std::println(stderr, "An unexpected error: {}", e.what());
+      return 1;
+    }
+  }
+
+  if (paths.size() != 1) {
+    std::println(
+      stderr,
+      "Usage: {} [--object <hex_id> | --chat [--json] | --session | --follow] "
+      "[--filter <expr>] [--checkpoint <file>] [--stop-after <n>] [--memory-stats] "
+      "[--trace <file>] <path_wrpl>\n"
+      "       {} --header-only [--json] <path_wrpl>...\n"
+      "       {} --merge <path_wrpl> <path_wrpl>...\n"
+      "       {} --aggregate <group_bys> [--filter <expr>] [--json] <path_wrpl>...\n"
+      "       {} serve <socket_path> [--cache-mb <n>]\n"
+      "       {} index build|query <index_file> <arg>...",
+      argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]
+    );
+    return 1;
+  }
+
+  try {
+    const std::filesystem::path wrpl_path = paths.front();
+    if (mode == run_mode::session) {
+      return print_session(wrpl_path);
+    }
+    if (mode == run_mode::follow) {
+      return print_followed_replay(wrpl_path, filter);
+    }
+
+    // keep stdout clean for machine readable output
+    std::FILE* info = json ? stderr : stdout;
+    std::optional<std::vector<char>> buffer = read_replay(wrpl_path);
+    if (!buffer) {
+      return 1;
+    }
+    std::streamsize size = static_cast<std::streamsize>(buffer->size());
+    std::println(info, "Read {} bytes from {}", size, wrpl_path.string());
+    std::string_view file_content(buffer->data(), size);
     std::optional<std::string_view> zlib_data = find_stream(file_content);
 
     if (!zlib_data) {
@@ -65,15 +573,48 @@ int main(int argc, char* argv[]) {
     }
 
     std::println(
-      "Found zlib stream at offset {}. Size: {} bytes", zlib_data->data() - file_content.data(),
-      zlib_data->size()
+      info, "Found zlib stream at offset {}. Size: {} bytes",
+      zlib_data->data() - file_content.data(), zlib_data->size()
     );
 
-    std::stringstream zlib_stream;
-    zlib_stream.write(zlib_data->data(), zlib_data->size());
-    zlib_stream.seekg(0);
+    wrpl::memory_istream zlib_stream(std::as_bytes(std::span(*zlib_data)));
+
+    if (mode == run_mode::chat) {
+      wrpl::print_chat_transcript(wrpl::extract_chat(zlib_stream), json);
+      return 0;
+    }
+
+    if (mode == run_mode::object) {
+      // the index lives next to the replay so later queries for any object skip the full parse;
+      // it is rebuilt once the replay no longer has the size and mtime it was built from
+      std::filesystem::path index_path = wrpl_path;
+      index_path += ".objidx";
+      std::optional<wrpl::replay_stamp> stamp = wrpl::stamp_replay(wrpl_path);
+      std::optional<wrpl::object_index> index = load_object_index(index_path);
+      if (!index || !stamp || index->source() != *stamp) {
+        index = wrpl::build_object_index(zlib_stream);
+        index->set_source(stamp.value_or(wrpl::replay_stamp{}));
+        if (stamp && !save_object_index(index_path, *index)) {
+          std::println(stderr, "Could not write object index to {}", index_path.string());
+        }
+        zlib_stream.clear();
+        zlib_stream.seekg(0);
+      }
+      wrpl::process_object(zlib_stream, *index, *object_id);
+      return 0;
+    }
 
-    wrpl::process_stream(zlib_stream);
+    std::uint64_t packet_limit = stop_after.value_or(std::numeric_limits<std::uint64_t>::max());
+    if (checkpoint_path) {
+      std::optional<wrpl::replay_stamp> stamp = wrpl::stamp_replay(wrpl_path);
+      if (!stamp) {
+        std::println(stderr, "Could not stat {}", wrpl_path.string());
+        return 1;
+      }
+      return process_with_checkpoint(zlib_stream, filter, *checkpoint_path, packet_limit, *stamp);
+    }
+    wrpl::packet_framer framer(zlib_stream, filter);
+    wrpl::process_stream(framer, packet_limit);
 
   } catch (const std::exception& e) {
     std::println(stderr, "An unexpected error: {}", e.what());
@@ -0,0 +1,168 @@
+// Global allocation hooks, linked into WRPL_MEMORY_STATS builds only. Every block carries a
+// header with its size and the stage that allocated it, so a free is charged back to that stage
+// even when another stage (or thread) releases it. Over-aligned blocks are placed inside a larger
+// malloc block, and the header records how far in.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+import memory_stats;
+
+namespace {
+
+  struct alignas(std::max_align_t) block_header {
+    std::size_t size;
+    // bytes between the malloc block and this header; 0 unless the block is over-aligned
+    std::uint32_t offset;
+    wrpl::memory_stage stage;
+  };
+
+  void* allocate(std::size_t size) noexcept {
+    auto* header = static_cast<block_header*>(std::malloc(sizeof(block_header) + size));
+    if (!header) {
+      return nullptr;
+    }
+    header->size = size;
+    header->offset = 0;
+    header->stage = wrpl::current_memory_stage();
+    wrpl::record_allocation(header->stage, size);
+    return header + 1;
+  }
+
+  void* allocate(std::size_t size, std::align_val_t alignment) noexcept {
+    auto align = static_cast<std::size_t>(alignment);
+    if (align <= alignof(block_header)) {
+      return allocate(size);
+    }
+    std::size_t padding = sizeof(block_header) + align - 1;
+    if (size > SIZE_MAX - padding || align > UINT32_MAX) {
+      return nullptr;
+    }
+    auto* base = static_cast<std::byte*>(std::malloc(padding + size));
+    if (!base) {
+      return nullptr;
+    }
+    auto address = reinterpret_cast<std::uintptr_t>(base + sizeof(block_header));
+    auto* block = base + sizeof(block_header) + ((align - address % align) % align);
+    block_header* header = reinterpret_cast<block_header*>(block) - 1;
+    header->size = size;
+    header->offset = static_cast<std::uint32_t>(reinterpret_cast<std::byte*>(header) - base);
+    header->stage = wrpl::current_memory_stage();
+    wrpl::record_allocation(header->stage, size);
+    return block;
+  }
+
+  [[noreturn]] void fail_allocation() {
+#if defined(__cpp_exceptions)
+    throw std::bad_alloc();
+#else
+    std::abort();
+#endif
+  }
+
+  void* allocate_or_fail(std::size_t size) {
+    if (void* block = allocate(size)) {
+      return block;
+    }
+    fail_allocation();
+  }
+
+  void* allocate_or_fail(std::size_t size, std::align_val_t alignment) {
+    if (void* block = allocate(size, alignment)) {
+      return block;
+    }
+    fail_allocation();
+  }
+
+  void release(void* block) noexcept {
+    if (!block) {
+      return;
+    }
+    block_header* header = static_cast<block_header*>(block) - 1;
+    wrpl::record_free(header->stage, header->size);
+    std::free(reinterpret_cast<std::byte*>(header) - header->offset);
+  }
+
+} // namespace
+
+void* operator new(std::size_t size) {
+  return allocate_or_fail(size);
+}
+
+void* operator new[](std::size_t size) {
+  return allocate_or_fail(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size);
+}
+
+void operator delete(void* block) noexcept {
+  release(block);
+}
+
+void operator delete[](void* block) noexcept {
+  release(block);
+}
+
+void operator delete(void* block, std::size_t) noexcept {
+  release(block);
+}
+
+void operator delete[](void* block, std::size_t) noexcept {
+  release(block);
+}
+
+void operator delete(void* block, const std::nothrow_t&) noexcept {
+  release(block);
+}
+
+void operator delete[](void* block, const std::nothrow_t&) noexcept {
+  release(block);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  return allocate_or_fail(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+  return allocate_or_fail(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+  return allocate(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+  return allocate(size, alignment);
+}
+
+void operator delete(void* block, std::align_val_t) noexcept {
+  release(block);
+}
+
+void operator delete[](void* block, std::align_val_t) noexcept {
+  release(block);
+}
+
+void operator delete(void* block, std::size_t, std::align_val_t) noexcept {
+  release(block);
+}
+
+void operator delete[](void* block, std::size_t, std::align_val_t) noexcept {
+  release(block);
+}
+
+void operator delete(void* block, std::align_val_t, const std::nothrow_t&) noexcept {
+  release(block);
+}
+
+void operator delete[](void* block, std::align_val_t, const std::nothrow_t&) noexcept {
+  release(block);
+}